@@ -8,7 +8,7 @@
 #include "arch/amiga/amiga.pb.h"
 #include "lib/encoders/encoders.pb.h"
 
-static bool lastBit;
+static thread_local bool lastBit;
 
 static int charToInt(char c)
 {
@@ -13,7 +13,7 @@
 #include <ctype.h>
 #include "lib/bytes.h"
 
-static bool lastBit;
+static thread_local bool lastBit;
 
 static int encode_data_gcr(uint8_t data)
 {
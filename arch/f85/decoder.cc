@@ -29,22 +29,16 @@ static int decode_data_gcr(uint8_t gcr)
     return -1;
 }
 
-static Bytes decode(const std::vector<bool>& bits)
+static Bytes decode(const RawBits& bits)
 {
     Bytes output;
     ByteWriter bw(output);
     BitWriter bitw(bw);
 
-    auto ii = bits.begin();
-    while (ii != bits.end())
+    for (size_t pos = 0; pos < bits.size(); pos += 5)
     {
-        uint8_t inputfifo = 0;
-        for (size_t i = 0; i < 5; i++)
-        {
-            if (ii == bits.end())
-                break;
-            inputfifo = (inputfifo << 1) | *ii++;
-        }
+        unsigned count = std::min<size_t>(bits.size() - pos, 5);
+        uint8_t inputfifo = bits.read(pos, count);
 
         bitw.push(decode_data_gcr(inputfifo), 4);
     }
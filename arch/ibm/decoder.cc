@@ -113,6 +113,7 @@ public:
 
         Bytes bytes;
         ByteWriter bw(bytes);
+        CrcState crc(crc16spec(CCITT_POLY));
 
         auto readByte = [&]()
         {
@@ -120,6 +121,7 @@ public:
             auto bytes = decodeFmMfm(bits).slice(0, 1);
             uint8_t byte = bytes[0];
             bw.write_8(byte);
+            crc.update(byte);
             return byte;
         };
 
@@ -137,7 +139,8 @@ public:
         br.seek(bw.pos);
 
         auto bits = readRawBits(IBM_IDAM_LEN * 16);
-        bw += decodeFmMfm(bits).slice(0, IBM_IDAM_LEN);
+        auto header = decodeFmMfm(bits).slice(0, IBM_IDAM_LEN);
+        bw += header;
 
         IbmDecoderProto::TrackdataProto trackdata;
         getTrackFormat(
@@ -148,7 +151,7 @@ public:
         _sector->logicalSector = br.read_8();
         _currentSectorSize = 1 << (br.read_8() + 7);
 
-        uint16_t gotCrc = crc16(CCITT_POLY, bytes.slice(0, br.pos));
+        uint16_t gotCrc = crc.update(header.slice(0, 4)).value();
         uint16_t wantCrc = br.read_be16();
         if (wantCrc == gotCrc)
             _sector->status =
@@ -175,6 +178,7 @@ public:
 
         Bytes bytes;
         ByteWriter bw(bytes);
+        CrcState crc(crc16spec(CCITT_POLY));
 
         auto readByte = [&]()
         {
@@ -182,6 +186,7 @@ public:
             auto bytes = decodeFmMfm(bits).slice(0, 1);
             uint8_t byte = bytes[0];
             bw.write_8(byte);
+            crc.update(byte);
             return byte;
         };
 
@@ -203,7 +208,7 @@ public:
         bw += decodeFmMfm(bits).slice(0, _currentSectorSize + 2);
 
         _sector->data = br.read(_currentSectorSize);
-        uint16_t gotCrc = crc16(CCITT_POLY, bytes.slice(0, br.pos));
+        uint16_t gotCrc = crc.update(_sector->data).value();
         uint16_t wantCrc = br.read_be16();
         _sector->status =
             (wantCrc == gotCrc) ? Sector::OK : Sector::BAD_CHECKSUM;
@@ -11,7 +11,7 @@
 #include "arch/macintosh/macintosh.pb.h"
 #include <ctype.h>
 
-static bool lastBit;
+static thread_local bool lastBit;
 
 static double clockRateUsForTrack(unsigned track)
 {
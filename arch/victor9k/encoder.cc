@@ -13,7 +13,7 @@
 #include <ctype.h>
 #include "lib/bytes.h"
 
-static bool lastBit;
+static thread_local bool lastBit;
 
 static void write_zero_bits(
     std::vector<bool>& bits, unsigned& cursor, unsigned count)
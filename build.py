@@ -22,13 +22,16 @@ cxxlibrary(
     srcs=[
         "./lib/bitmap.cc",
         "./lib/bytes.cc",
+        "./lib/calibration.cc",
         "./lib/config.cc",
         "./lib/crc.cc",
         "./lib/csvreader.cc",
+        "./lib/decoders/decoderparams.cc",
         "./lib/decoders/decoders.cc",
         "./lib/decoders/fluxdecoder.cc",
         "./lib/decoders/fluxmapreader.cc",
         "./lib/decoders/fmmfm.cc",
+        "./lib/decoders/rawbits.cc",
         "./lib/encoders/encoders.cc",
         "./lib/fl2.cc",
         "./lib/flags.cc",
@@ -173,9 +176,11 @@ cxxlibrary(
         "lib/a2r.h": "./lib/a2r.h",
         "lib/bitmap.h": "./lib/bitmap.h",
         "lib/bytes.h": "./lib/bytes.h",
+        "lib/calibration.h": "./lib/calibration.h",
         "lib/config.h": "./lib/config.h",
         "lib/crc.h": "./lib/crc.h",
         "lib/csvreader.h": "./lib/csvreader.h",
+        "lib/decoders/decoderparams.h": "./lib/decoders/decoderparams.h",
         "lib/decoders/decoders.h": "./lib/decoders/decoders.h",
         "lib/decoders/fluxdecoder.h": "./lib/decoders/fluxdecoder.h",
         "lib/decoders/fluxmapreader.h": "./lib/decoders/fluxmapreader.h",
@@ -193,16 +193,15 @@ std::vector<Bytes> Bytes::split(uint8_t separator) const
 {
     std::vector<Bytes> vector;
 
-    int lastEnd = 0;
-    for (int i = 0; i < size(); i++)
+    const uint8_t* start = cbegin();
+    for (;;)
     {
-        if ((*this)[i] == separator)
-        {
-            vector.push_back(this->slice(lastEnd, i - lastEnd));
-            lastEnd = i + 1;
-        }
+        const uint8_t* end = std::find(start, cend(), separator);
+        vector.push_back(this->slice(start - cbegin(), end - start));
+        if (end == cend())
+            break;
+        start = end + 1;
     }
-    vector.push_back(this->slice(lastEnd));
 
     return vector;
 }
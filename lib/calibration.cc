@@ -0,0 +1,132 @@
+#include "lib/globals.h"
+#include "lib/calibration.h"
+#include "lib/config.h"
+#include "lib/logger.h"
+#include "lib/usb/usb.h"
+#include "lib/utils.h"
+#include "lib/config.pb.h"
+#include <fstream>
+#include <filesystem>
+#include <ctime>
+#include <unistd.h>
+
+static DriveCalibrationCacheProto loadCalibrationCache(
+    const std::string& filename)
+{
+    DriveCalibrationCacheProto cache;
+    std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+    if (ifs.is_open() && !cache.ParseFromIstream(&ifs))
+    {
+        /* A corrupt cache only costs a remeasurement. */
+
+        log("ignoring unreadable calibration cache '{}'", filename);
+        cache.Clear();
+    }
+    return cache;
+}
+
+static void saveCalibrationCache(
+    const std::string& filename, const DriveCalibrationCacheProto& cache)
+{
+    /* Several processes may be using the cache at once, so make sure nobody
+     * ever sees a partially written file. The cache is only an optimisation,
+     * so failing to write it isn't fatal. */
+
+    std::string tempname = fmt::format("{}.{}", filename, getpid());
+    {
+        std::ofstream of(tempname, std::ios::out | std::ios::binary);
+        bool written = cache.SerializeToOstream(&of);
+        of.close();
+        if (!written || of.fail())
+        {
+            warning("unable to write calibration cache '{}'", tempname);
+            std::error_code ec;
+            std::filesystem::remove(tempname, ec);
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempname, filename, ec);
+    if (ec)
+    {
+        warning("unable to replace calibration cache '{}': {}",
+            filename,
+            ec.message());
+        std::filesystem::remove(tempname, ec);
+    }
+}
+
+static bool isSameDrive(const DriveCalibrationProto& calibration,
+    const std::string& serial,
+    const DriveProto& drive)
+{
+    return (calibration.serial() == serial) &&
+           (calibration.drive() == drive.drive()) &&
+           (calibration.high_density() == drive.high_density()) &&
+           (calibration.index_mode() == drive.index_mode()) &&
+           (calibration.hard_sector_count() == drive.hard_sector_count());
+}
+
+nanoseconds_t findCachedRotationalPeriod()
+{
+    const auto& drive = globalConfig()->drive();
+    if (!drive.has_calibration_cache())
+        return 0;
+
+    auto cache = loadCalibrationCache(drive.calibration_cache());
+    auto serial = getUsbSerial();
+    int64_t now = std::time(nullptr);
+    for (const auto& calibration : cache.calibration())
+    {
+        if (!isSameDrive(calibration, serial, drive))
+            continue;
+
+        int64_t age = now - calibration.timestamp();
+        if ((age < 0) || (age > drive.calibration_max_age_s()) ||
+            (calibration.rotational_period_ms() <= 0))
+        {
+            log("cached rotational period is stale");
+            return 0;
+        }
+
+        log("using cached rotational period from {}",
+            toIso8601(calibration.timestamp()));
+        return calibration.rotational_period_ms() * 1e6;
+    }
+
+    return 0;
+}
+
+void cacheRotationalPeriod(nanoseconds_t oneRevolution)
+{
+    const auto& drive = globalConfig()->drive();
+    if (!drive.has_calibration_cache() || (oneRevolution == 0))
+        return;
+
+    auto cache = loadCalibrationCache(drive.calibration_cache());
+    auto serial = getUsbSerial();
+
+    DriveCalibrationProto* calibration = nullptr;
+    for (auto& c : *cache.mutable_calibration())
+    {
+        if (isSameDrive(c, serial, drive))
+        {
+            calibration = &c;
+            break;
+        }
+    }
+    if (!calibration)
+    {
+        calibration = cache.add_calibration();
+        calibration->set_serial(serial);
+        calibration->set_drive(drive.drive());
+        calibration->set_high_density(drive.high_density());
+        calibration->set_index_mode(drive.index_mode());
+        calibration->set_hard_sector_count(drive.hard_sector_count());
+    }
+    calibration->set_rotational_period_ms(oneRevolution / 1e6);
+    calibration->set_timestamp(std::time(nullptr));
+
+    saveCalibrationCache(drive.calibration_cache(), cache);
+}
@@ -0,0 +1,15 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+/* Looks up the rotational period of the current drive in the calibration
+ * cache. Returns 0 if the cache is disabled, or if there's no entry or it's
+ * stale. */
+
+extern nanoseconds_t findCachedRotationalPeriod();
+
+/* Records a freshly measured rotational period in the calibration cache, if
+ * there is one. */
+
+extern void cacheRotationalPeriod(nanoseconds_t oneRevolution);
+
+#endif
@@ -229,6 +229,11 @@ ConfigProto* Config::combined()
         /* Merge in the overrides once again. */
 
         _combinedConfig.MergeFrom(_overridesConfig);
+
+        /* Anything computed during the reentrant calls above saw a partial
+         * config, so make sure it gets thrown away. */
+
+        _generation++;
     }
     return &_combinedConfig;
 }
@@ -236,11 +241,13 @@ ConfigProto* Config::combined()
 void Config::invalidate()
 {
     _configValid = false;
+    _generation++;
 }
 
 void Config::clear()
 {
     _configValid = false;
+    _generation++;
     _baseConfig.Clear();
     _overridesConfig.Clear();
     _combinedConfig.Clear();
@@ -336,6 +343,7 @@ void Config::set(std::string key, std::string value)
 void Config::setTransient(std::string key, std::string value)
 {
     setProtoByString(&_combinedConfig, key, value);
+    _generation++;
 }
 
 std::string Config::get(std::string key)
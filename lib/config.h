@@ -97,6 +97,14 @@ public:
 
     void invalidate();
 
+    /* Changes whenever the combined config might have changed, so that
+     * anything computed from it knows when to recompute. */
+
+    unsigned generation() const
+    {
+        return _generation;
+    }
+
     /* Check option validity. Returns a list of errors. */
 
     std::vector<std::string> validate();
@@ -174,6 +182,7 @@ private:
     ConfigProto _combinedConfig;
     std::set<std::string> _appliedOptions;
     bool _configValid;
+    unsigned _generation = 0;
 
     std::shared_ptr<FluxSource> _fluxSource;
     std::shared_ptr<ImageReader> _imageReader;
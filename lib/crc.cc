@@ -1,9 +1,11 @@
 #include "lib/globals.h"
 #include "lib/bytes.h"
 #include "lib/crc.h"
+#include <map>
+#include <mutex>
 
 template <class T>
-T reflect(T bin, unsigned width = sizeof(T) * 8)
+constexpr T reflect(T bin, unsigned width = sizeof(T) * 8)
 {
     T bout = 0;
     while (width--)
@@ -15,32 +17,196 @@ T reflect(T bin, unsigned width = sizeof(T) * 8)
     return bout;
 }
 
-uint64_t generic_crc(const struct crcspec& spec, const Bytes& bytes)
+/* Non-reflected CRCs are kept left-aligned in a 64-bit register, so the same
+ * tables work for any width; reflected ones are kept right-aligned. Table k
+ * gives the effect of shifting a byte through k+1 bytes' worth of register,
+ * so eight input bytes can be folded in with eight independent lookups. */
+
+struct CrcTables
 {
-    uint64_t crc = spec.init;
-    uint64_t top = 1LL << (spec.width - 1);
-    uint64_t mask = (top << 1) - 1;
+    uint64_t t[8][256];
+};
+
+static constexpr uint64_t alignPoly(uint64_t poly, unsigned width)
+{
+    return poly << (64 - width);
+}
 
-    for (uint8_t b : bytes)
+static constexpr CrcTables makeTables(uint64_t poly, bool reflected)
+{
+    CrcTables tables = {};
+    for (unsigned i = 0; i < 256; i++)
     {
-        if (spec.refin)
-            b = reflect(b);
+        uint64_t crc = reflected ? i : ((uint64_t)i << 56);
+        for (int j = 0; j < 8; j++)
+        {
+            if (reflected)
+                crc = (crc & 1) ? ((crc >> 1) ^ poly) : (crc >> 1);
+            else
+                crc = (crc >> 63) ? ((crc << 1) ^ poly) : (crc << 1);
+        }
+        tables.t[0][i] = crc;
+    }
 
-        for (uint8_t i = 0x80; i != 0; i >>= 1)
+    for (unsigned k = 1; k < 8; k++)
+        for (unsigned i = 0; i < 256; i++)
+        {
+            uint64_t crc = tables.t[k - 1][i];
+            if (reflected)
+                crc = (crc >> 8) ^ tables.t[0][crc & 0xff];
+            else
+                crc = (crc << 8) ^ tables.t[0][crc >> 56];
+            tables.t[k][i] = crc;
+        }
+
+    return tables;
+}
+
+static constexpr CrcTables ccittTables =
+    makeTables(alignPoly(CCITT_POLY, 16), false);
+static constexpr CrcTables modbusTables =
+    makeTables(alignPoly(MODBUS_POLY, 16), false);
+static constexpr CrcTables modbusRefTables =
+    makeTables(MODBUS_POLY_REF, true);
+static constexpr CrcTables brotherTables =
+    makeTables(alignPoly(BROTHER_POLY, 24), false);
+
+static const CrcTables* findTables(uint64_t poly, bool reflected)
+{
+    if (!reflected)
+    {
+        if (poly == alignPoly(CCITT_POLY, 16))
+            return &ccittTables;
+        if (poly == alignPoly(MODBUS_POLY, 16))
+            return &modbusTables;
+        if (poly == alignPoly(BROTHER_POLY, 24))
+            return &brotherTables;
+    }
+    else if (poly == MODBUS_POLY_REF)
+        return &modbusRefTables;
+
+    static std::mutex mutex;
+    static std::map<std::pair<uint64_t, bool>, std::unique_ptr<CrcTables>>
+        cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& tables = cache[std::make_pair(poly, reflected)];
+    if (!tables)
+        tables = std::make_unique<CrcTables>(makeTables(poly, reflected));
+    return tables.get();
+}
+
+static uint64_t widthMask(unsigned width)
+{
+    uint64_t top = 1ULL << (width - 1);
+    return (top << 1) - 1;
+}
+
+CrcState::CrcState(const crcspec& spec):
+    _spec(spec),
+    _reflected(spec.refin && spec.refout)
+{
+    uint64_t mask = widthMask(spec.width);
+    if (_reflected)
+    {
+        _tables = findTables(reflect(spec.poly & mask, spec.width), true);
+        _crc = reflect(spec.init & mask, spec.width);
+    }
+    else
+    {
+        _tables = findTables(alignPoly(spec.poly & mask, spec.width), false);
+        _crc = (spec.init & mask) << (64 - spec.width);
+    }
+}
+
+CrcState& CrcState::update(const uint8_t* data, size_t len)
+{
+    const auto& t = _tables->t;
+    uint64_t crc = _crc;
+
+    if (_reflected)
+    {
+        while (len >= 8)
+        {
+            uint64_t word = 0;
+            for (int i = 7; i >= 0; i--)
+                word = (word << 8) | data[i];
+            crc ^= word;
+            crc = t[7][crc & 0xff] ^ t[6][(crc >> 8) & 0xff] ^
+                  t[5][(crc >> 16) & 0xff] ^ t[4][(crc >> 24) & 0xff] ^
+                  t[3][(crc >> 32) & 0xff] ^ t[2][(crc >> 40) & 0xff] ^
+                  t[1][(crc >> 48) & 0xff] ^ t[0][crc >> 56];
+            data += 8;
+            len -= 8;
+        }
+
+        while (len--)
+            crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+    }
+    else if (!_spec.refin)
+    {
+        while (len >= 8)
         {
-            uint64_t bit = crc & top;
-            crc <<= 1;
-            if (b & i)
-                bit ^= top;
-            if (bit)
-                crc ^= spec.poly;
+            uint64_t word = 0;
+            for (int i = 0; i < 8; i++)
+                word = (word << 8) | data[i];
+            crc ^= word;
+            crc = t[7][crc >> 56] ^ t[6][(crc >> 48) & 0xff] ^
+                  t[5][(crc >> 40) & 0xff] ^ t[4][(crc >> 32) & 0xff] ^
+                  t[3][(crc >> 24) & 0xff] ^ t[2][(crc >> 16) & 0xff] ^
+                  t[1][(crc >> 8) & 0xff] ^ t[0][crc & 0xff];
+            data += 8;
+            len -= 8;
         }
+
+        while (len--)
+            crc = (crc << 8) ^ t[0][(crc >> 56) ^ *data++];
+    }
+    else
+    {
+        /* Reflected input but not output; this is rare enough that it can
+         * go a byte at a time. */
+
+        while (len--)
+            crc = (crc << 8) ^ t[0][(crc >> 56) ^ reverse_bits(*data++)];
     }
 
-    if (spec.refout)
-        crc = reflect(crc, spec.width);
-    crc ^= spec.xorout;
-    return crc & mask;
+    _crc = crc;
+    return *this;
+}
+
+CrcState& CrcState::update(const Bytes& bytes)
+{
+    return update(bytes.cbegin(), bytes.size());
+}
+
+uint64_t CrcState::value() const
+{
+    uint64_t crc;
+    if (_reflected)
+        crc = _crc;
+    else
+    {
+        crc = _crc >> (64 - _spec.width);
+        if (_spec.refout)
+            crc = reflect(crc, _spec.width);
+    }
+    return (crc ^ _spec.xorout) & widthMask(_spec.width);
+}
+
+crcspec crc16spec(uint16_t poly, uint16_t init)
+{
+    return {16, poly, init, 0, false, false};
+}
+
+crcspec crc16refspec(uint16_t poly, uint16_t init)
+{
+    return {16, reflect(poly), reflect(init), 0, true, true};
+}
+
+uint64_t generic_crc(const struct crcspec& spec, const Bytes& bytes)
+{
+    return CrcState(spec).update(bytes).value();
 }
 
 uint16_t sumBytes(const Bytes& bytes)
@@ -65,45 +231,25 @@ uint8_t xorBytes(const Bytes& bytes)
 
 uint16_t crc16(uint16_t poly, uint16_t crc, const Bytes& bytes)
 {
-    ByteReader br(bytes);
-
-    while (!br.eof())
-    {
-        crc ^= br.read_8() << 8;
-        for (int i = 0; i < 8; i++)
-            crc = (crc & 0x8000) ? ((crc << 1) ^ poly) : (crc << 1);
-    }
-
-    return crc;
+    return CrcState(crc16spec(poly, crc)).update(bytes).value();
 }
 
 uint16_t crc16ref(uint16_t poly, uint16_t crc, const Bytes& bytes)
 {
-    ByteReader br(bytes);
-
-    while (!br.eof())
-    {
-        crc ^= br.read_8();
-        for (int i = 0; i < 8; i++)
-            crc = (crc & 0x0001) ? ((crc >> 1) ^ poly) : (crc >> 1);
-    }
-
-    return crc;
+    return CrcState(crc16refspec(poly, crc)).update(bytes).value();
 }
 
 /* Thanks to user202729 on StackOverflow for miraculously reverse engineering
- * this. */
+ * this. Unlike the others, each byte is shifted in at the bottom of the
+ * register rather than folded in at the top. */
 uint32_t crcbrother(const Bytes& bytes)
 {
     ByteReader br(bytes);
+    const auto& t0 = brotherTables.t[0];
 
-    uint32_t crc = br.read_8();
+    uint64_t crc = (uint64_t)br.read_8() << 40;
     while (!br.eof())
-    {
-        for (int i = 0; i < 8; i++)
-            crc = (crc & 0x800000) ? ((crc << 1) ^ BROTHER_POLY) : (crc << 1);
-        crc ^= br.read_8();
-    }
+        crc = (crc << 8) ^ t0[crc >> 56] ^ ((uint64_t)br.read_8() << 40);
 
-    return crc & 0xFFFFFF;
+    return crc >> 40;
 }
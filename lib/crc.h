@@ -16,6 +16,39 @@ struct crcspec
     bool refout;
 };
 
+struct CrcTables;
+
+/* Computes a CRC incrementally, so that decoders can fold bytes in as they
+ * go rather than rescanning a buffer at the end. Eight bytes at a time are
+ * processed with slice-by-8 lookup tables; the tables for the polynomials
+ * defined above are built at compile time, and any others are built the
+ * first time they're used. */
+
+class CrcState
+{
+public:
+    CrcState(const crcspec& spec);
+
+    CrcState& update(const uint8_t* data, size_t len);
+    CrcState& update(const Bytes& bytes);
+
+    CrcState& update(uint8_t byte)
+    {
+        return update(&byte, 1);
+    }
+
+    uint64_t value() const;
+
+private:
+    crcspec _spec;
+    bool _reflected;
+    const CrcTables* _tables;
+    uint64_t _crc;
+};
+
+extern crcspec crc16spec(uint16_t poly, uint16_t init = 0xffff);
+extern crcspec crc16refspec(uint16_t poly, uint16_t init = 0xffff);
+
 extern uint64_t generic_crc(const struct crcspec& spec, const Bytes& bytes);
 
 extern uint16_t sumBytes(const Bytes& bytes);
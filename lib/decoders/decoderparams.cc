@@ -0,0 +1,16 @@
+#include "lib/globals.h"
+#include "lib/decoders/decoderparams.h"
+#include "lib/decoders/decoders.pb.h"
+
+DecoderParams::DecoderParams(): DecoderParams(DecoderProto()) {}
+
+DecoderParams::DecoderParams(const DecoderProto& config):
+    pulseDebounceThreshold(config.pulse_debounce_threshold()),
+    bitErrorThreshold(config.bit_error_threshold()),
+    minimumClock(config.minimum_clock_us() * 1000),
+    pllAdjust(config.pll_adjust()),
+    pllPhase(config.pll_phase()),
+    fluxScale(config.flux_scale()),
+    fixedPointPll(config.fixed_point_pll())
+{
+}
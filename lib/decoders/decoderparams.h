@@ -0,0 +1,24 @@
+#ifndef DECODERPARAMS_H
+#define DECODERPARAMS_H
+
+class DecoderProto;
+
+/* The handful of decoder settings which the flux reading code needs over
+ * and over again, copied out of the config so that the inner loops don't
+ * have to go through protobuf accessors (or the config) to get at them. */
+
+struct DecoderParams
+{
+    DecoderParams();
+    explicit DecoderParams(const DecoderProto& config);
+
+    double pulseDebounceThreshold;
+    double bitErrorThreshold;
+    nanoseconds_t minimumClock;
+    double pllAdjust;
+    double pllPhase;
+    double fluxScale;
+    bool fixedPointPll;
+};
+
+#endif
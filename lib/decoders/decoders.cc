@@ -67,11 +67,24 @@ std::shared_ptr<TrackDataFlux> Decoder::decodeToSectors(
     std::shared_ptr<const Fluxmap> fluxmap,
     std::shared_ptr<const TrackInfo>& trackInfo)
 {
+    /* Decoded tracks are kept in memory for as long as the disk is (the GUI
+     * keeps the whole thing), so store mostly empty flux compactly. It's
+     * still decoded from the original, which is quicker to read. */
+
     _trackdata = std::make_shared<TrackDataFlux>();
-    _trackdata->fluxmap = fluxmap;
+    _trackdata->fluxmap = fluxmap->compacted();
+    if (!_trackdata->fluxmap)
+        _trackdata->fluxmap = fluxmap;
     _trackdata->trackInfo = trackInfo;
 
-    FluxmapReader fmr(*fluxmap);
+    /* Decoders live for as long as the config does, and the config may have
+     * been changed since the last track; so take a fresh copy of the
+     * parameters, and make sure the FluxDecoder gets rebuilt to match. */
+
+    _params = DecoderParams(_config);
+    _decoder.reset();
+
+    FluxmapReader fmr(*fluxmap, _params);
     _fmr = &fmr;
 
     auto newSector = [&]
@@ -136,11 +149,7 @@ std::shared_ptr<TrackDataFlux> Decoder::decodeToSectors(
         }
 
         if (_sector->status != Sector::MISSING)
-        {
-            auto trackLayout = Layout::getLayoutOfTrack(
-                _sector->logicalTrack, _sector->logicalSide);
             _trackdata->sectors.push_back(_sector);
-        }
     }
 }
 
@@ -164,13 +173,21 @@ void Decoder::pushRecord(
 
 void Decoder::resetFluxDecoder()
 {
-    _decoder.reset(new FluxDecoder(_fmr, _sector->clock, _config));
+    startFluxDecoder(_sector->clock);
+}
+
+void Decoder::startFluxDecoder(nanoseconds_t clock)
+{
+    if (_decoder)
+        _decoder->reset(_fmr, clock);
+    else
+        _decoder.reset(new FluxDecoder(_fmr, clock, _params));
 }
 
 nanoseconds_t Decoder::seekToPattern(const FluxMatcher& pattern)
 {
     nanoseconds_t clock = _fmr->seekToPattern(pattern);
-    _decoder.reset(new FluxDecoder(_fmr, clock, _config));
+    startFluxDecoder(clock);
     return clock;
 }
 
@@ -180,48 +197,67 @@ void Decoder::seekToIndexMark()
     _fmr->seekToIndexMark();
 }
 
-std::vector<bool> Decoder::readRawBits(unsigned count)
+RawBits Decoder::readRawBits(unsigned count)
+{
+    size_t start = _recordBits.size();
+    _decoder->readBits(_recordBits, count);
+    return _recordBits.slice(start, _recordBits.size() - start);
+}
+
+/* Reads `count` raw bits as a big-endian integer. Short reads at the end of
+ * the track take the slow path through toBytes() so that they behave exactly
+ * as they always have. */
+
+static uint64_t readRawInteger(Decoder& decoder, unsigned count)
 {
-    auto bits = _decoder->readBits(count);
-    _recordBits.insert(_recordBits.end(), bits.begin(), bits.end());
-    return bits;
+    auto bits = decoder.readRawBits(count);
+    if (bits.size() == count)
+        return bits.read(0, count);
+
+    unsigned width = (count + 7) & ~7;
+    RawBits padded;
+    padded.append(0, width - count);
+    padded.append(bits);
+
+    Bytes bytes = toBytes(padded);
+    ByteReader br(bytes);
+    uint64_t value = 0;
+    for (unsigned i = 0; i < width / 8; i++)
+        value = (value << 8) | br.read_8();
+    return value;
 }
 
 uint8_t Decoder::readRaw8()
 {
-    return toBytes(readRawBits(8)).reader().read_8();
+    return readRawInteger(*this, 8);
 }
 
 uint16_t Decoder::readRaw16()
 {
-    return toBytes(readRawBits(16)).reader().read_be16();
+    return readRawInteger(*this, 16);
 }
 
 uint32_t Decoder::readRaw20()
 {
-    std::vector<bool> bits(4);
-    for (bool b : readRawBits(20))
-        bits.push_back(b);
-
-    return toBytes(bits).reader().read_be24();
+    return readRawInteger(*this, 20);
 }
 
 uint32_t Decoder::readRaw24()
 {
-    return toBytes(readRawBits(24)).reader().read_be24();
+    return readRawInteger(*this, 24);
 }
 
 uint32_t Decoder::readRaw32()
 {
-    return toBytes(readRawBits(32)).reader().read_be32();
+    return readRawInteger(*this, 32);
 }
 
 uint64_t Decoder::readRaw48()
 {
-    return toBytes(readRawBits(48)).reader().read_be48();
+    return readRawInteger(*this, 48);
 }
 
 uint64_t Decoder::readRaw64()
 {
-    return toBytes(readRawBits(64)).reader().read_be64();
+    return readRawInteger(*this, 64);
 }
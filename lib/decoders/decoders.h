@@ -4,20 +4,31 @@
 #include "lib/bytes.h"
 #include "lib/sector.h"
 #include "lib/decoders/fluxmapreader.h"
+#include "lib/decoders/rawbits.h"
 #include "lib/decoders/fluxdecoder.h"
 
 class Sector;
 class Fluxmap;
 class FluxmapReader;
-class RawBits;
 class DecoderProto;
 
 #include "lib/flux.h"
 
 extern void setDecoderManualClockRate(double clockrate_us);
 
-extern Bytes decodeFmMfm(std::vector<bool>::const_iterator start,
-    std::vector<bool>::const_iterator end);
+enum FmMfmKernel
+{
+    FMMFM_KERNEL_BEST,
+    FMMFM_KERNEL_TABLE,
+    FMMFM_KERNEL_BMI2
+};
+
+/* The fastest available kernel is picked at startup; this is for testing.
+ * Returns false if the kernel isn't supported on this machine. */
+extern bool setFmMfmKernel(FmMfmKernel kernel);
+
+extern Bytes decodeFmMfm(
+    RawBits::const_iterator start, RawBits::const_iterator end);
 extern void encodeMfm(std::vector<bool>& bits,
     unsigned& cursor,
     const Bytes& input,
@@ -26,15 +37,20 @@ extern void encodeFm(
     std::vector<bool>& bits, unsigned& cursor, const Bytes& input);
 extern Bytes encodeMfm(const Bytes& input, bool& lastBit);
 
-static inline Bytes decodeFmMfm(const std::vector<bool> bits)
+static inline Bytes decodeFmMfm(const RawBits& bits)
 {
     return decodeFmMfm(bits.begin(), bits.end());
 }
 
+static inline Bytes decodeFmMfm(const std::vector<bool>& bits)
+{
+    return decodeFmMfm(RawBits(bits));
+}
+
 class Decoder
 {
 public:
-    Decoder(const DecoderProto& config): _config(config) {}
+    Decoder(const DecoderProto& config): _config(config), _params(config) {}
 
     virtual ~Decoder() {}
 
@@ -57,7 +73,7 @@ public:
         const Fluxmap::Position& start, const Fluxmap::Position& end);
 
     void resetFluxDecoder();
-    std::vector<bool> readRawBits(unsigned count);
+    RawBits readRawBits(unsigned count);
     uint8_t readRaw8();
     uint16_t readRaw16();
     uint32_t readRaw20();
@@ -101,12 +117,15 @@ protected:
     virtual void decodeDataRecord(){};
 
     const DecoderProto& _config;
+    DecoderParams _params;
     std::shared_ptr<TrackDataFlux> _trackdata;
     std::shared_ptr<Sector> _sector;
     std::unique_ptr<FluxDecoder> _decoder;
-    std::vector<bool> _recordBits;
+    RawBits _recordBits;
 
 private:
+    void startFluxDecoder(nanoseconds_t clock);
+
     FluxmapReader* _fmr = nullptr;
 };
 
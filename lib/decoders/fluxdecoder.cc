@@ -2,7 +2,7 @@
 #include "lib/fluxmap.h"
 #include "lib/decoders/fluxmapreader.h"
 #include "lib/decoders/fluxdecoder.h"
-#include "lib/decoders/decoders.pb.h"
+#include <cmath>
 
 /* This is a port of the samdisk code:
  *
@@ -12,22 +12,65 @@
  * than my code.
  */
 
-FluxDecoder::FluxDecoder(
-    FluxmapReader* fmr, nanoseconds_t bitcell, const DecoderProto& config):
-    _fmr(fmr),
-    _pll_phase(config.pll_phase()),
-    _pll_adjust(config.pll_adjust()),
-    _flux_scale(config.flux_scale()),
-    _clock(bitcell),
-    _clock_centre(bitcell),
-    _clock_min(bitcell * (1.0 - _pll_adjust)),
-    _clock_max(bitcell * (1.0 + _pll_adjust)),
-    _flux(0),
-    _leading_zeroes(fmr->tell().zeroes)
+static constexpr int FIXED_SHIFT = 24;
+
+static int64_t toFixed(double value)
+{
+    return llround(value * (1 << FIXED_SHIFT));
+}
+
+static int64_t ticksToFixed(nanoseconds_t ns)
 {
+    return toFixed(ns / NS_PER_TICK);
+}
+
+static int64_t fixedMultiply(int64_t value, int64_t factor)
+{
+    return (value * factor + (1 << (FIXED_SHIFT - 1))) >> FIXED_SHIFT;
+}
+
+FluxDecoder::FluxDecoder(FluxmapReader* fmr,
+    nanoseconds_t bitcell,
+    const DecoderParams& params):
+    _pll_phase(params.pllPhase),
+    _pll_adjust(params.pllAdjust),
+    _flux_scale(params.fluxScale),
+    _fixed_point(params.fixedPointPll),
+    _fixed_pll_keep(toFixed(1.0 - _pll_phase)),
+    _fixed_pll_adjust(toFixed(_pll_adjust)),
+    _fixed_flux_scale(toFixed(_flux_scale))
+{
+    reset(fmr, bitcell);
+}
+
+void FluxDecoder::reset(FluxmapReader* fmr, nanoseconds_t bitcell)
+{
+    _fmr = fmr;
+    _clock = bitcell;
+    _clock_centre = bitcell;
+    _clock_min = bitcell * (1.0 - _pll_adjust);
+    _clock_max = bitcell * (1.0 + _pll_adjust);
+    _flux = 0;
+    _clocked_zeroes = 0;
+    _goodbits = 0;
+    _index = false;
+    _sync_lost = false;
+    _leading_zeroes = fmr->tell().zeroes;
+
+    _debounce_ticks = fmr->debounceThreshold(_clock_centre);
+    _fixed_clock = ticksToFixed(_clock);
+    _fixed_clock_centre = ticksToFixed(_clock_centre);
+    _fixed_clock_min = ticksToFixed(_clock_min);
+    _fixed_clock_max = ticksToFixed(_clock_max);
+    _fixed_flux = 0;
 }
 
 bool FluxDecoder::readBit()
+{
+    return _fixed_point ? readFixedBit() : readFloatBit();
+}
+
+bool FluxDecoder::readFloatBit()
 {
     if (_leading_zeroes > 0)
     {
@@ -90,20 +133,98 @@ bool FluxDecoder::readBit()
     return true;
 }
 
-std::vector<bool> FluxDecoder::readBits(unsigned count)
+/* This is the same algorithm as readFloatBit(), but done with integers in
+ * units of flux ticks, so the intervals from the FluxmapReader can be used
+ * as they are. With 24 bits of fraction it agrees with the floating point
+ * version except when a pulse lands exactly on a window edge, i.e. the flux
+ * left over is exactly half a clock. This version always counts that pulse
+ * as being in the next window; the floating point one goes one way or the
+ * other depending on how the conversion to nanoseconds rounded. Real flux
+ * only ties like this by chance, as the leftover flux has to come out at
+ * exactly half the current clock to 24 bits of fraction. */
+
+bool FluxDecoder::readFixedBit()
 {
-    std::vector<bool> result;
-    while (!_fmr->eof() && count--)
+    if (_leading_zeroes > 0)
     {
-        bool b = readBit();
-        result.push_back(b);
+        _leading_zeroes--;
+        return false;
+    }
+    else if (_leading_zeroes == 0)
+    {
+        _leading_zeroes--;
+        return true;
+    }
+
+    while (!_fmr->eof() && (_fixed_flux < (_fixed_clock >> 1)))
+    {
+        _fixed_flux += (int64_t)_fmr->readDebouncedInterval(_debounce_ticks) *
+                       _fixed_flux_scale;
+        _clocked_zeroes = 0;
     }
+
+    _fixed_flux -= _fixed_clock;
+    if (_fixed_flux >= (_fixed_clock >> 1))
+    {
+        _clocked_zeroes++;
+        _goodbits++;
+        return false;
+    }
+
+    if (_clocked_zeroes <= 3)
+        _fixed_clock += fixedMultiply(_fixed_flux, _fixed_pll_adjust);
+    else
+    {
+        _fixed_clock += fixedMultiply(
+            _fixed_clock_centre - _fixed_clock, _fixed_pll_adjust);
+
+        if (_goodbits >= 256)
+            _sync_lost = true;
+        _goodbits = 0;
+    }
+
+    _fixed_clock = std::min(
+        std::max(_fixed_clock_min, _fixed_clock), _fixed_clock_max);
+    _fixed_flux = fixedMultiply(_fixed_flux, _fixed_pll_keep);
+
+    _goodbits++;
+    return true;
+}
+
+unsigned FluxDecoder::readBits(RawBits& output, unsigned count)
+{
+    unsigned read = 0;
+    if (_fixed_point)
+    {
+        while ((read < count) && !_fmr->eof())
+        {
+            output.push_back(readFixedBit());
+            read++;
+        }
+    }
+    else
+    {
+        while ((read < count) && !_fmr->eof())
+        {
+            output.push_back(readFloatBit());
+            read++;
+        }
+    }
+    return read;
+}
+
+RawBits FluxDecoder::readBits(unsigned count)
+{
+    RawBits result;
+    if (count != UINT_MAX)
+        result.reserve(count);
+    readBits(result, count);
     return result;
 }
 
-std::vector<bool> FluxDecoder::readBits(const Fluxmap::Position& until)
+RawBits FluxDecoder::readBits(const Fluxmap::Position& until)
 {
-    std::vector<bool> result;
+    RawBits result;
     while (!_fmr->eof() && (_fmr->tell().bytes < until.bytes))
     {
         bool b = readBit();
@@ -1,24 +1,38 @@
 #ifndef FLUXDECODER_H
 #define FLUXDECODER_H
 
+#include "lib/decoders/rawbits.h"
+
 class FluxmapReader;
+struct DecoderParams;
 
 class FluxDecoder
 {
 public:
-    FluxDecoder(
-        FluxmapReader* fmr, nanoseconds_t bitcell, const DecoderProto& config);
+    FluxDecoder(FluxmapReader* fmr,
+        nanoseconds_t bitcell,
+        const DecoderParams& params);
+
+    /* Restarts the PLL at the reader's current position, exactly as if a new
+     * FluxDecoder had been constructed. */
+    void reset(FluxmapReader* fmr, nanoseconds_t bitcell);
 
     bool readBit();
-    std::vector<bool> readBits(unsigned count);
-    std::vector<bool> readBits(const Fluxmap::Position& until);
+    RawBits readBits(unsigned count);
+    RawBits readBits(const Fluxmap::Position& until);
 
-    std::vector<bool> readBits()
+    RawBits readBits()
     {
         return readBits(UINT_MAX);
     }
 
+    /* Appends up to count bits to output, stopping early at the end of the
+     * flux; returns the number of bits read. */
+    unsigned readBits(RawBits& output, unsigned count);
+
 private:
+    bool readFloatBit();
+    bool readFixedBit();
     nanoseconds_t nextFlux();
 
 private:
@@ -26,6 +40,7 @@ private:
     double _pll_phase;
     double _pll_adjust;
     double _flux_scale;
+    bool _fixed_point;
     nanoseconds_t _clock = 0;
     nanoseconds_t _clock_centre;
     nanoseconds_t _clock_min;
@@ -36,6 +51,18 @@ private:
     bool _index = false;
     bool _sync_lost = false;
     int _leading_zeroes;
+
+    /* The fixed-point PLL's state: times are in ticks and factors are plain
+     * numbers, both scaled by 2^FIXED_SHIFT. */
+    unsigned _debounce_ticks;
+    int64_t _fixed_pll_keep;
+    int64_t _fixed_pll_adjust;
+    int64_t _fixed_flux_scale;
+    int64_t _fixed_clock;
+    int64_t _fixed_clock_centre;
+    int64_t _fixed_clock_min;
+    int64_t _fixed_clock_max;
+    int64_t _fixed_flux;
 };
 
 #endif
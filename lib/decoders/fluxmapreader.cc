@@ -9,32 +9,72 @@
 #include <strings.h>
 
 FluxmapReader::FluxmapReader(const Fluxmap& fluxmap):
+    FluxmapReader(fluxmap, DecoderParams(globalConfig()->decoder()))
+{
+}
+
+FluxmapReader::FluxmapReader(
+    const Fluxmap& fluxmap, const DecoderParams& params):
     _fluxmap(fluxmap),
-    _bytes(fluxmap.ptr()),
-    _size(fluxmap.bytes()),
-    _config(globalConfig()->decoder())
+    _events(fluxmap.eventIndex()),
+    _bytes(_events->bytecode.cbegin()),
+    _size(_events->bytecode.size()),
+    _params(params)
 {
     rewind();
 }
 
 void FluxmapReader::getNextEvent(int& event, unsigned& ticks)
 {
-    ticks = 0;
-
-    while (!eof())
+    const auto& events = *_events;
+    if (_event < events.size())
     {
-        uint8_t b = _bytes[_pos.bytes++];
-        ticks += b & 0x3f;
-        if (!b || (b & (F_BIT_PULSE | F_BIT_INDEX)))
-        {
-            _pos.ticks += ticks;
-            event = b & 0xc0;
-            return;
-        }
+        /* If we've been seeked into the middle of a run of non-event bytes,
+         * only part of the interval remains. */
+
+        unsigned start = _event ? events.offsets[_event - 1] : 0;
+        unsigned end = events.offsets[_event];
+        if (_pos.bytes == start)
+            ticks = events.intervals[_event];
+        else
+            ticks = sumTicks(_pos.bytes, end);
+
+        event = _bytes[end - 1] & 0xc0;
+        _pos.bytes = end;
+        _event++;
+    }
+    else
+    {
+        unsigned start = events.size() ? events.offsets.back() : 0;
+        if (_pos.bytes == start)
+            ticks = events.trailingTicks;
+        else
+            ticks = sumTicks(_pos.bytes, _size);
+
+        event = F_EOF;
+        _pos.bytes = _size;
     }
 
     _pos.ticks += ticks;
-    event = F_EOF;
+}
+
+unsigned FluxmapReader::sumTicks(unsigned start, unsigned end) const
+{
+    unsigned ticks = 0;
+    while (start < end)
+        ticks += _bytes[start++] & 0x3f;
+    return ticks;
+}
+
+void FluxmapReader::seek(const Fluxmap::Position& pos)
+{
+    _pos = pos;
+
+    /* Find the first event which ends after this position. */
+
+    const auto& offsets = _events->offsets;
+    _event = std::upper_bound(offsets.begin(), offsets.end(), _pos.bytes) -
+             offsets.begin();
 }
 
 void FluxmapReader::skipToEvent(int event)
@@ -66,8 +106,16 @@ bool FluxmapReader::findEvent(int event, unsigned& ticks)
 
 unsigned FluxmapReader::readInterval(nanoseconds_t clock)
 {
-    unsigned thresholdTicks =
-        (clock * _config.pulse_debounce_threshold()) / NS_PER_TICK;
+    return readDebouncedInterval(debounceThreshold(clock));
+}
+
+unsigned FluxmapReader::debounceThreshold(nanoseconds_t clock) const
+{
+    return (clock * _params.pulseDebounceThreshold) / NS_PER_TICK;
+}
+
+unsigned FluxmapReader::readDebouncedInterval(unsigned thresholdTicks)
+{
     unsigned ticks = 0;
 
     while (ticks <= thresholdTicks)
@@ -130,34 +178,79 @@ FluxPattern::FluxPattern(unsigned bits, uint64_t pattern): _bits(bits)
     }
 }
 
-bool FluxPattern::matches(const unsigned* end, FluxMatch& match) const
+bool FluxPattern::matches(const unsigned* end,
+    const DecoderParams& params,
+    FluxMatch& match) const
 {
-    const double clockDecodeThreshold =
-        globalConfig()->decoder().bit_error_threshold();
     const unsigned* start = end - _intervals.size();
     unsigned candidatelength = std::accumulate(start, end - _lowzero, 0);
+    return matches(end, candidatelength, params.bitErrorThreshold, match);
+}
+
+/* The error of a candidate interval c against the pattern interval p is
+ * (clock*p - c) / clock, where clock = S/L (S being the total length of the
+ * candidate intervals and L that of the pattern). Multiplying through by S
+ * gives S*p - c*L, which can be calculated exactly in integers and compared
+ * against threshold*S without any divisions. Only if the result is so close
+ * to the threshold that rounding in the original floating-point calculation
+ * could matter do we do it that way instead, so that the results are always
+ * identical. */
+
+static inline bool exceedsThreshold(int64_t candidateLength,
+    int64_t patternLength,
+    unsigned p,
+    unsigned c,
+    double threshold,
+    double limit,
+    bool absolute)
+{
+    double error = candidateLength * p - (int64_t)c * patternLength;
+    if (absolute)
+        error = fabs(error);
+    if (fabs(error - limit) > (limit * 1e-6))
+        return error > limit;
+
+    double clock = (double)candidateLength / (double)patternLength;
+    double ii = clock * (double)p;
+    double ci = (double)c;
+    error = (ii - ci) / clock;
+    if (absolute)
+        error = fabs(error);
+    return error > threshold;
+}
+
+bool FluxPattern::matches(const unsigned* end,
+    unsigned candidatelength,
+    double threshold,
+    FluxMatch& match) const
+{
     if (!candidatelength)
         return false;
+    const unsigned* start = end - _intervals.size();
     match.clock = (double)candidatelength / (double)_length;
+    double limit = threshold * candidatelength;
 
     unsigned exactIntervals = _intervals.size() - _lowzero;
     for (unsigned i = 0; i < exactIntervals; i++)
     {
-        double ii = match.clock * (double)_intervals[i];
-        double ci = (double)start[i];
-        double error = fabs((ii - ci) / match.clock);
-        if (error > clockDecodeThreshold)
+        if (exceedsThreshold(candidatelength,
+                _length,
+                _intervals[i],
+                start[i],
+                threshold,
+                limit,
+                true))
             return false;
     }
 
-    if (_lowzero)
-    {
-        double ii = match.clock * (double)_intervals[exactIntervals];
-        double ci = (double)start[exactIntervals];
-        double error = (ii - ci) / match.clock;
-        if (error > clockDecodeThreshold)
-            return false;
-    }
+    if (_lowzero && exceedsThreshold(candidatelength,
+                        _length,
+                        _intervals[exactIntervals],
+                        start[exactIntervals],
+                        threshold,
+                        limit,
+                        false))
+        return false;
 
     match.matcher = this;
     match.intervals = _intervals.size();
@@ -174,24 +267,62 @@ FluxMatchers::FluxMatchers(
         _intervals = std::max(_intervals, matcher->intervals());
 }
 
-bool FluxMatchers::matches(const unsigned* intervals, FluxMatch& match) const
+void FluxMatchers::collectPatterns(
+    std::vector<const FluxPattern*>& patterns) const
+{
+    for (const auto* matcher : _matchers)
+        matcher->collectPatterns(patterns);
+}
+
+bool FluxMatchers::matches(const unsigned* intervals,
+    const DecoderParams& params,
+    FluxMatch& match) const
 {
     for (const auto* matcher : _matchers)
     {
-        if (matcher->matches(intervals, match))
+        if (matcher->matches(intervals, params, match))
             return true;
     }
     return false;
 }
 
+/* Jumps forward to the last checkpoint which is before both the given tick
+ * count and byte offset, if that's ahead of the current position. A linear
+ * scan towards either target would pass through that checkpoint anyway, so
+ * this doesn't change where the scan ends up. */
+
+void FluxmapReader::skipToCheckpoint(unsigned ticks, unsigned bytes)
+{
+    const unsigned interval = Fluxmap::EventIndex::CHECKPOINT_INTERVAL;
+    const auto& offsets = _events->offsets;
+    const auto& checkpoints = _events->checkpointTicks;
+
+    size_t byTicks =
+        std::lower_bound(checkpoints.begin(), checkpoints.end(), ticks) -
+        checkpoints.begin();
+    size_t byBytes =
+        (std::lower_bound(offsets.begin(), offsets.end(), bytes) -
+            offsets.begin()) /
+        interval;
+    size_t count = std::min(byTicks, byBytes);
+    if (count == 0)
+        return;
+
+    unsigned event = count * interval;
+    if (offsets[event - 1] <= _pos.bytes)
+        return;
+
+    _pos.bytes = offsets[event - 1];
+    _pos.ticks = checkpoints[count - 1];
+    _event = event;
+}
+
 void FluxmapReader::seek(nanoseconds_t ns)
 {
     unsigned ticks = ns / NS_PER_TICK;
     if (ticks < _pos.ticks)
-    {
-        _pos.ticks = 0;
-        _pos.bytes = 0;
-    }
+        rewind();
+    skipToCheckpoint(ticks, UINT_MAX);
 
     while (!eof() && (_pos.ticks < ticks))
     {
@@ -205,10 +336,8 @@ void FluxmapReader::seek(nanoseconds_t ns)
 void FluxmapReader::seekToByte(unsigned b)
 {
     if (b < _pos.bytes)
-    {
-        _pos.ticks = 0;
-        _pos.bytes = 0;
-    }
+        rewind();
+    skipToCheckpoint(UINT_MAX, b);
 
     while (!eof() && (_pos.bytes < b))
     {
@@ -228,36 +357,57 @@ nanoseconds_t FluxmapReader::seekToPattern(const FluxMatcher& pattern)
 nanoseconds_t FluxmapReader::seekToPattern(
     const FluxMatcher& pattern, const FluxMatcher*& matching)
 {
+    const auto patterns = pattern.patterns();
+    const double threshold = _params.bitErrorThreshold;
+    const nanoseconds_t minimumClock = _params.minimumClock;
+
+    /* The most recent intervals are kept in a ring buffer. Each interval is
+     * stored twice, size entries apart, so that the last intervalCount of them
+     * are always contiguous in memory and can be handed straight to the
+     * matchers. A running total is kept for each slot so that the sum of any
+     * window of intervals is a single subtraction. */
+
     unsigned intervalCount = pattern.intervals();
-    std::vector<unsigned> candidates(intervalCount + 1);
-    std::vector<Fluxmap::Position> positions(intervalCount + 1);
+    unsigned size = 1;
+    while (size <= intervalCount)
+        size <<= 1;
+    unsigned mask = size - 1;
 
-    for (unsigned i = 0; i <= intervalCount; i++)
-    {
-        positions[i] = tell();
-        candidates[i] = 0;
-    }
+    std::vector<unsigned> candidates(size * 2);
+    std::vector<unsigned> totals(size);
+    std::vector<Fluxmap::Position> positions(size, tell());
+    unsigned head = 0;
+    unsigned total = 0;
 
     while (!eof())
     {
-        FluxMatch match;
-        if (pattern.matches(&*candidates.end(), match))
+        const unsigned* end = &candidates[head + size + 1];
+        for (const auto* p : patterns)
         {
-            seek(positions[intervalCount - match.intervals]);
-            _pos.zeroes = match.zeroes;
-            matching = match.matcher;
-            nanoseconds_t detectedClock = match.clock * NS_PER_TICK;
-            if (detectedClock > (_config.minimum_clock_us() * 1000))
-                return match.clock * NS_PER_TICK;
+            unsigned first = (head - p->intervals()) & mask;
+            unsigned last = (head - p->hasTrailingZeroes()) & mask;
+            unsigned candidateLength = totals[last] - totals[first];
+
+            FluxMatch match;
+            if (p->matches(end, candidateLength, threshold, match))
+            {
+                seek(positions[(head - match.intervals) & mask]);
+                _pos.zeroes = match.zeroes;
+                matching = match.matcher;
+                nanoseconds_t detectedClock = match.clock * NS_PER_TICK;
+                if (detectedClock > minimumClock)
+                    return match.clock * NS_PER_TICK;
+                break;
+            }
         }
 
-        for (unsigned i = 0; i < intervalCount; i++)
-        {
-            positions[i] = positions[i + 1];
-            candidates[i] = candidates[i + 1];
-        }
-        findEvent(F_BIT_PULSE, candidates[intervalCount]);
-        positions[intervalCount] = tell();
+        head = (head + 1) & mask;
+        unsigned interval;
+        findEvent(F_BIT_PULSE, interval);
+        candidates[head] = candidates[head + size] = interval;
+        total += interval;
+        totals[head] = total;
+        positions[head] = tell();
     }
 
     matching = NULL;
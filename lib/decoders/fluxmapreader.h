@@ -3,10 +3,11 @@
 
 #include "lib/fluxmap.h"
 #include "lib/flags.h"
+#include "lib/decoders/decoderparams.h"
 #include "protocol.h"
 
 class FluxMatcher;
-class DecoderProto;
+class FluxPattern;
 
 struct FluxMatch
 {
@@ -22,8 +23,25 @@ public:
     virtual ~FluxMatcher() {}
 
     /* Returns the number of intervals matched */
-    virtual bool matches(const unsigned* intervals, FluxMatch& match) const = 0;
+    virtual bool matches(const unsigned* intervals,
+        const DecoderParams& params,
+        FluxMatch& match) const = 0;
     virtual unsigned intervals() const = 0;
+
+    /* Every FluxPattern which makes up this matcher, in the order in which
+     * they're tried. seekToPattern() uses this to test all of them against
+     * the flux in a single pass. It's worked out each time rather than when
+     * the matcher is constructed, so it's always up to date with the objects
+     * as they currently are. */
+    std::vector<const FluxPattern*> patterns() const
+    {
+        std::vector<const FluxPattern*> patterns;
+        collectPatterns(patterns);
+        return patterns;
+    }
+
+    virtual void collectPatterns(
+        std::vector<const FluxPattern*>& patterns) const = 0;
 };
 
 class FluxPattern : public FluxMatcher
@@ -31,13 +49,36 @@ class FluxPattern : public FluxMatcher
 public:
     FluxPattern(unsigned bits, uint64_t patterns);
 
-    bool matches(const unsigned* intervals, FluxMatch& match) const override;
+    bool matches(const unsigned* intervals,
+        const DecoderParams& params,
+        FluxMatch& match) const override;
+
+    /* As above, but with the error threshold supplied and the sum of the
+     * candidate intervals (not including any trailing zero interval) already
+     * calculated. */
+    bool matches(const unsigned* intervals,
+        unsigned candidateLength,
+        double threshold,
+        FluxMatch& match) const;
 
     unsigned intervals() const override
     {
         return _intervals.size();
     }
 
+    void collectPatterns(
+        std::vector<const FluxPattern*>& patterns) const override
+    {
+        patterns.push_back(this);
+    }
+
+    /* Whether the last interval is a run of trailing zeroes, which is only
+     * matched as a minimum length. */
+    bool hasTrailingZeroes() const
+    {
+        return _lowzero;
+    }
+
 private:
     std::vector<unsigned> _intervals;
     unsigned _length;
@@ -48,6 +89,7 @@ private:
 public:
     friend void test_patternconstruction();
     friend void test_patternmatching();
+    friend void test_patternmatchingequivalence();
 };
 
 class FluxMatchers : public FluxMatcher
@@ -55,13 +97,18 @@ class FluxMatchers : public FluxMatcher
 public:
     FluxMatchers(const std::initializer_list<const FluxMatcher*> matchers);
 
-    bool matches(const unsigned* intervals, FluxMatch& match) const override;
+    bool matches(const unsigned* intervals,
+        const DecoderParams& params,
+        FluxMatch& match) const override;
 
     unsigned intervals() const override
     {
         return _intervals;
     }
 
+    void collectPatterns(
+        std::vector<const FluxPattern*>& patterns) const override;
+
 private:
     unsigned _intervals;
     std::vector<const FluxMatcher*> _matchers;
@@ -70,14 +117,20 @@ private:
 class FluxmapReader
 {
 public:
+    /* Without any parameters, the decoder settings are taken from the global
+     * config. */
     FluxmapReader(const Fluxmap& fluxmap);
+    FluxmapReader(const Fluxmap& fluxmap, const DecoderParams& params);
     FluxmapReader(const Fluxmap&& fluxmap) = delete;
+    FluxmapReader(
+        const Fluxmap&& fluxmap, const DecoderParams& params) = delete;
 
     void rewind()
     {
         _pos.bytes = 0;
         _pos.ticks = 0;
         _pos.zeroes = 0;
+        _event = 0;
     }
 
     bool eof() const
@@ -91,10 +144,7 @@ public:
     }
 
     /* Important! You can only reliably seek to 1 bits. */
-    void seek(const Fluxmap::Position& pos)
-    {
-        _pos = pos;
-    }
+    void seek(const Fluxmap::Position& pos);
 
     int getDuration(void)
     {
@@ -105,6 +155,13 @@ public:
     void skipToEvent(int event);
     bool findEvent(int event, unsigned& ticks);
     unsigned readInterval(nanoseconds_t clock); /* with debounce support */
+    unsigned debounceThreshold(nanoseconds_t clock) const;
+    unsigned readDebouncedInterval(unsigned thresholdTicks);
+
+    const DecoderParams& params() const
+    {
+        return _params;
+    }
 
     /* Important! You can only reliably seek to 1 bits. */
     void seek(nanoseconds_t ns);
@@ -115,12 +172,18 @@ public:
     nanoseconds_t seekToPattern(
         const FluxMatcher& pattern, const FluxMatcher*& matching);
 
+private:
+    unsigned sumTicks(unsigned start, unsigned end) const;
+    void skipToCheckpoint(unsigned ticks, unsigned bytes);
+
 private:
     const Fluxmap& _fluxmap;
+    std::shared_ptr<const Fluxmap::EventIndex> _events;
     const uint8_t* _bytes;
     const size_t _size;
     Fluxmap::Position _pos;
-    const DecoderProto& _config;
+    unsigned _event; /* index of the next event to be read */
+    const DecoderParams _params;
 };
 
 #endif
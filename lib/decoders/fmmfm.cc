@@ -1,57 +1,200 @@
 #include "lib/globals.h"
 #include "lib/decoders/decoders.h"
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define FMMFM_HAVE_BMI2
+#endif
 
-Bytes decodeFmMfm(
-    std::vector<bool>::const_iterator ii, std::vector<bool>::const_iterator end)
-{
-    /*
-     * FM is dumb as rocks, consisting on regular clock pulses with data pulses
-     * in the gaps. 0x00 is:
-     *
-     *     X-X-X-X-X-X-X-X-
-     *
-     * 0xff is:
-     *
-     *     XXXXXXXXXXXXXXXX
-     *
-     * So we just need to extract all the odd bits.
-     *
-     * MFM and M2FM are slightly more complicated, where the first bit of each
-     * pair can be either 0 or 1... but the second bit is always the data bit,
-     * and at this point we simply don't care what the first bit is, so
-     * decoding MFM uses just the same code!
-     */
+/*
+ * FM is dumb as rocks, consisting on regular clock pulses with data pulses
+ * in the gaps. 0x00 is:
+ *
+ *     X-X-X-X-X-X-X-X-
+ *
+ * 0xff is:
+ *
+ *     XXXXXXXXXXXXXXXX
+ *
+ * So we just need to extract all the odd bits.
+ *
+ * MFM and M2FM are slightly more complicated, where the first bit of each
+ * pair can be either 0 or 1... but the second bit is always the data bit,
+ * and at this point we simply don't care what the first bit is, so
+ * decoding MFM uses just the same code!
+ *
+ * Both directions are done a word at a time: decoding gathers the data bits
+ * out of 64 raw bits at once, and encoding spreads a byte out into the odd
+ * bits of a 16-bit word and fills in the clock bits around it. The portable
+ * kernels use lookup tables; on x86-64 machines with BMI2 we use PEXT and
+ * PDEP instead.
+ */
 
-    Bytes bytes;
-    ByteWriter bw(bytes);
+static constexpr uint64_t DATA_BITS = 0x5555555555555555ULL;
+static constexpr uint32_t DATA_BITS_32 = 0x55555555u;
 
-    int bitcount = 0;
-    uint8_t fifo = 0;
+struct FmMfmKernels
+{
+    uint32_t (*gatherDataBits)(uint64_t raw);
+    uint16_t (*spreadDataBits)(uint8_t data);
+};
 
-    while (ii != end)
+namespace
+{
+    struct Tables
     {
-        ii++; /* skip clock bit */
-        if (ii == end)
-            break;
-        fifo = (fifo << 1) | *ii++;
+        uint8_t gather[256];
+        uint16_t spread[256];
 
-        bitcount++;
-        if (bitcount == 8)
+        constexpr Tables(): gather{}, spread{}
         {
-            bw.write_8(fifo);
-            bitcount = 0;
+            for (unsigned i = 0; i < 256; i++)
+            {
+                for (int j = 0; j < 4; j++)
+                    if (i & (1 << (j * 2)))
+                        gather[i] |= 1 << j;
+                for (int j = 0; j < 8; j++)
+                    if (i & (1 << j))
+                        spread[i] |= 1 << (j * 2);
+            }
         }
+    };
+}
+
+static constexpr Tables tables;
+
+static uint32_t gatherDataBitsTable(uint64_t raw)
+{
+    uint32_t data = 0;
+    for (int i = 56; i >= 0; i -= 8)
+        data = (data << 4) | tables.gather[(raw >> i) & 0xff];
+    return data;
+}
+
+static uint16_t spreadDataBitsTable(uint8_t data)
+{
+    return tables.spread[data];
+}
+
+static const FmMfmKernels tableKernels = {
+    gatherDataBitsTable, spreadDataBitsTable};
+
+#if defined(FMMFM_HAVE_BMI2)
+__attribute__((target("bmi2"))) static uint32_t gatherDataBitsBmi2(
+    uint64_t raw)
+{
+    return _pext_u64(raw, DATA_BITS);
+}
+
+__attribute__((target("bmi2"))) static uint16_t spreadDataBitsBmi2(
+    uint8_t data)
+{
+    return _pdep_u32(data, DATA_BITS_32);
+}
+
+static const FmMfmKernels bmi2Kernels = {
+    gatherDataBitsBmi2, spreadDataBitsBmi2};
+#endif
+
+static const FmMfmKernels* pickKernels()
+{
+#if defined(FMMFM_HAVE_BMI2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("bmi2"))
+        return &bmi2Kernels;
+#endif
+    return &tableKernels;
+}
+
+static const FmMfmKernels* kernels = pickKernels();
+
+bool setFmMfmKernel(FmMfmKernel kernel)
+{
+    switch (kernel)
+    {
+        case FMMFM_KERNEL_TABLE:
+            kernels = &tableKernels;
+            return true;
+
+        case FMMFM_KERNEL_BMI2:
+#if defined(FMMFM_HAVE_BMI2)
+            if (__builtin_cpu_supports("bmi2"))
+            {
+                kernels = &bmi2Kernels;
+                return true;
+            }
+#endif
+            return false;
+
+        case FMMFM_KERNEL_BEST:
+            kernels = pickKernels();
+            return true;
     }
+    return false;
+}
+
+/* Returns the sixteen raw bits for a byte, where lastBit is the final data
+ * bit written before it. FM has a clock pulse in every cell; MFM only has
+ * one where neither neighbouring data bit is set. */
+
+static uint16_t encodeFmByte(uint8_t data)
+{
+    return kernels->spreadDataBits(data) | 0xaaaa;
+}
+
+static uint16_t encodeMfmByte(uint8_t data, bool lastBit)
+{
+    uint8_t clocks = ~(data | (data >> 1) | (lastBit << 7));
+    return kernels->spreadDataBits(data) |
+           (kernels->spreadDataBits(clocks) << 1);
+}
+
+Bytes decodeFmMfm(RawBits::const_iterator ii, RawBits::const_iterator end)
+{
+    Bytes bytes;
+    if (ii == end)
+        return bytes;
+
+    ByteWriter bw(bytes);
+    const RawBits& bits = ii.bits();
+    size_t pos = ii.pos();
+    size_t endPos = end.pos();
+
+    while ((endPos - pos) >= 64)
+    {
+        bw.write_be32(kernels->gatherDataBits(bits.read(pos, 64)));
+        pos += 64;
+    }
+
+    /* Any trailing clock bit without a data bit is ignored, and a trailing
+     * partial byte is padded with zeroes on the right. */
 
-    if (bitcount != 0)
+    unsigned remaining = endPos - pos;
+    unsigned dataBits = remaining / 2;
+    if (dataBits != 0)
     {
-        fifo <<= 8 - bitcount;
-        bw.write_8(fifo);
+        uint64_t raw = bits.read(pos, remaining) << (64 - remaining);
+        uint32_t data = kernels->gatherDataBits(raw);
+        for (unsigned i = 0; i < dataBits; i += 8)
+        {
+            bw.write_8(data >> 24);
+            data <<= 8;
+        }
     }
 
     return bytes;
 }
 
+/* The std::vector<bool> encoders stop as soon as there's no room for another
+ * pair of bits, so only whole bytes which are known to fit go through the
+ * word-level path. */
+
+static void writeRawWord(
+    std::vector<bool>& bits, unsigned& cursor, uint16_t word)
+{
+    for (int i = 15; i >= 0; i--)
+        bits[cursor++] = (word >> i) & 1;
+}
+
 void encodeFm(std::vector<bool>& bits, unsigned& cursor, const Bytes& input)
 {
     if (bits.size() == 0)
@@ -60,6 +203,12 @@ void encodeFm(std::vector<bool>& bits, unsigned& cursor, const Bytes& input)
 
     for (uint8_t b : input)
     {
+        if ((cursor + 16) <= bits.size())
+        {
+            writeRawWord(bits, cursor, encodeFmByte(b));
+            continue;
+        }
+
         for (int i = 0; i < 8; i++)
         {
             bool bit = b & 0x80;
@@ -85,6 +234,13 @@ void encodeMfm(std::vector<bool>& bits,
 
     for (uint8_t b : input)
     {
+        if ((cursor + 16) <= bits.size())
+        {
+            writeRawWord(bits, cursor, encodeMfmByte(b, lastBit));
+            lastBit = b & 1;
+            continue;
+        }
+
         for (int i = 0; i < 8; i++)
         {
             bool bit = b & 0x80;
@@ -102,21 +258,14 @@ void encodeMfm(std::vector<bool>& bits,
 
 Bytes encodeMfm(const Bytes& input, bool& lastBit)
 {
-    ByteReader br(input);
-    BitReader bitr(br);
     Bytes b;
     ByteWriter bw(b);
-    BitWriter bitw(bw);
 
-    while (!bitr.eof())
+    for (uint8_t data : input)
     {
-        uint8_t bit = bitr.get();
-
-        bitw.push(!lastBit && !bit);
-        bitw.push(bit);
-        lastBit = bit;
+        bw.write_be16(encodeMfmByte(data, lastBit));
+        lastBit = data & 1;
     }
 
-    bitw.flush();
     return b;
 }
@@ -0,0 +1,62 @@
+#include "lib/globals.h"
+#include "lib/bytes.h"
+#include "lib/decoders/rawbits.h"
+
+RawBits::RawBits(const std::vector<bool>& bits)
+{
+    reserve(bits.size());
+    for (bool b : bits)
+        push_back(b);
+}
+
+void RawBits::append(const RawBits& other)
+{
+    unsigned offset = _size % 64;
+    if (offset == 0)
+    {
+        _words.insert(_words.end(), other._words.begin(), other._words.end());
+        _size += other._size;
+        return;
+    }
+
+    _words.reserve((_size + other._size + 63) / 64);
+    for (uint64_t word : other._words)
+    {
+        _words.back() |= word >> offset;
+        _words.push_back(word << (64 - offset));
+    }
+    _size += other._size;
+    _words.resize((_size + 63) / 64);
+}
+
+RawBits RawBits::slice(size_t pos, size_t count) const
+{
+    RawBits result;
+    if (pos >= _size)
+        return result;
+    count = std::min(count, _size - pos);
+
+    result.reserve(count);
+    while (count != 0)
+    {
+        unsigned chunk = std::min<size_t>(count, 64);
+        result.append(read(pos, chunk), chunk);
+        pos += chunk;
+        count -= chunk;
+    }
+    return result;
+}
+
+std::vector<bool> RawBits::toVector() const
+{
+    return std::vector<bool>(begin(), end());
+}
+
+Bytes toBytes(const RawBits& bits)
+{
+    Bytes bytes((bits.size() + 7) / 8);
+    uint8_t* p = bytes.begin();
+    for (size_t pos = 0; pos < bits.size(); pos += 8)
+        *p++ = bits.read(pos, std::min<size_t>(bits.size() - pos, 8));
+    return bytes;
+}
@@ -1,46 +1,244 @@
 #ifndef RAWBITS_H
 #define RAWBITS_H
 
+class Bytes;
+
+/* A growable stream of bits, packed MSB-first into 64-bit words. Bits past
+ * the end of the stream are always zero, which lets read() extract integers
+ * with a couple of shifts rather than a bit at a time. */
+
 class RawBits
 {
 public:
-    RawBits(std::unique_ptr<std::vector<bool>> bits,
-        std::unique_ptr<std::vector<size_t>> indices):
-        _bits(std::move(bits)),
-        _indices(std::move(indices))
+    class const_iterator
     {
-    }
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef bool value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef void pointer;
+        typedef bool reference;
+
+        const_iterator() {}
+
+        const_iterator(const RawBits* bits, size_t pos):
+            _bits(bits),
+            _pos(pos)
+        {
+        }
+
+        bool operator*() const
+        {
+            return (*_bits)[_pos];
+        }
+
+        bool operator[](difference_type delta) const
+        {
+            return (*_bits)[_pos + delta];
+        }
+
+        const_iterator& operator++()
+        {
+            _pos++;
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            _pos++;
+            return old;
+        }
+
+        const_iterator& operator--()
+        {
+            _pos--;
+            return *this;
+        }
+
+        const_iterator operator--(int)
+        {
+            const_iterator old = *this;
+            _pos--;
+            return old;
+        }
+
+        const_iterator& operator+=(difference_type delta)
+        {
+            _pos += delta;
+            return *this;
+        }
+
+        const_iterator& operator-=(difference_type delta)
+        {
+            _pos -= delta;
+            return *this;
+        }
+
+        const_iterator operator+(difference_type delta) const
+        {
+            return const_iterator(_bits, _pos + delta);
+        }
 
-    typedef std::vector<bool>::const_iterator const_iterator;
+        const_iterator operator-(difference_type delta) const
+        {
+            return const_iterator(_bits, _pos - delta);
+        }
+
+        difference_type operator-(const const_iterator& other) const
+        {
+            return (difference_type)_pos - (difference_type)other._pos;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            return _pos == other._pos;
+        }
+
+        bool operator!=(const const_iterator& other) const
+        {
+            return _pos != other._pos;
+        }
+
+        bool operator<(const const_iterator& other) const
+        {
+            return _pos < other._pos;
+        }
+
+        const RawBits& bits() const
+        {
+            return *_bits;
+        }
+
+        size_t pos() const
+        {
+            return _pos;
+        }
+
+    private:
+        const RawBits* _bits = nullptr;
+        size_t _pos = 0;
+    };
+
+public:
+    RawBits() {}
+    explicit RawBits(const std::vector<bool>& bits);
 
     const_iterator begin() const
     {
-        return _bits->begin();
+        return const_iterator(this, 0);
     }
 
     const_iterator end() const
     {
-        return _bits->end();
+        return const_iterator(this, _size);
     }
 
     size_t size() const
     {
-        return _bits->size();
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    void clear()
+    {
+        _words.clear();
+        _size = 0;
+    }
+
+    void reserve(size_t bits)
+    {
+        _words.reserve((bits + 63) / 64);
+    }
+
+    bool operator[](size_t pos) const
+    {
+        return (_words[pos / 64] >> (63 - (pos % 64))) & 1;
+    }
+
+    bool at(size_t pos) const
+    {
+        if (pos >= _size)
+            throw std::out_of_range("bit access out of range");
+        return (*this)[pos];
+    }
+
+    bool operator==(const RawBits& other) const
+    {
+        return (_size == other._size) && (_words == other._words);
+    }
+
+    bool operator!=(const RawBits& other) const
+    {
+        return !(*this == other);
     }
 
-    const bool operator[](size_t pos) const
+    void push_back(bool bit)
     {
-        return _bits->at(pos);
+        unsigned offset = _size % 64;
+        if (offset == 0)
+            _words.push_back(0);
+        if (bit)
+            _words.back() |= 1ULL << (63 - offset);
+        _size++;
+    }
+
+    /* Appends the bottom `count` bits of `value`, most significant first. */
+
+    void append(uint64_t value, unsigned count)
+    {
+        if (count == 0)
+            return;
+        value <<= 64 - count;
+
+        unsigned offset = _size % 64;
+        if (offset == 0)
+            _words.push_back(value);
+        else
+        {
+            _words.back() |= value >> offset;
+            if ((offset + count) > 64)
+                _words.push_back(value << (64 - offset));
+        }
+        _size += count;
     }
 
-    const std::vector<size_t> indices() const
+    void append(const RawBits& other);
+
+    /* Returns the `count` bits (at most 64) starting at `pos` as a big-endian
+     * integer. Bits past the end of the stream read as zero. */
+
+    uint64_t read(size_t pos, unsigned count) const
     {
-        return *_indices;
+        if (count == 0)
+            return 0;
+
+        size_t word = pos / 64;
+        unsigned offset = pos % 64;
+        if (word >= _words.size())
+            return 0;
+
+        uint64_t value = _words[word] << offset;
+        if (((offset + count) > 64) && ((word + 1) < _words.size()))
+            value |= _words[word + 1] >> (64 - offset);
+        return value >> (64 - count);
     }
 
+    RawBits slice(size_t pos, size_t count) const;
+    std::vector<bool> toVector() const;
+
 private:
-    std::unique_ptr<std::vector<bool>> _bits;
-    std::unique_ptr<std::vector<size_t>> _indices;
+    std::vector<uint64_t> _words;
+    size_t _size = 0;
 };
 
+/* As with the std::vector<bool> version, a trailing partial byte is
+ * right-aligned. */
+
+extern Bytes toBytes(const RawBits& bits);
+
 #endif
@@ -1,10 +1,19 @@
 #include "lib/globals.h"
 #include "lib/proto.h"
 #include "lib/fluxmap.h"
+#include "lib/bytes.h"
+#include "lib/fl2.h"
 #include "lib/fl2.pb.h"
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <fstream>
 
-static void upgradeFluxFile(FluxFileProto& proto)
+static constexpr uint8_t INDEX_OFFSET_TAG =
+    (FluxFileProto::kIndexOffsetFieldNumber << 3) | 1;
+static constexpr int FOOTER_SIZE = 9;
+
+static void upgradeFluxFile(FluxFileProto& proto,
+    std::function<Bytes(const FluxChunkProto&)> readChunk)
 {
     if (proto.version() == FluxFileVersion::VERSION_1)
     {
@@ -26,40 +35,127 @@ static void upgradeFluxFile(FluxFileProto& proto)
         proto.set_version(FluxFileVersion::VERSION_2);
     }
 
-    if (proto.version() > FluxFileVersion::VERSION_2)
+    if (proto.version() == FluxFileVersion::VERSION_3)
+    {
+        /* Pull each compressed chunk back inline. (The other direction happens
+         * in saveFl2File(), as the chunk offsets are only known once the file
+         * is being written.) */
+
+        for (auto& track : *proto.mutable_track())
+        {
+            for (const auto& chunk : track.chunk())
+                track.add_flux(readChunk(chunk));
+            track.clear_chunk();
+        }
+
+        proto.clear_chunk_data();
+        proto.clear_index_offset();
+        proto.clear_flux_encoding();
+        proto.set_version(FluxFileVersion::VERSION_2);
+    }
+
+    if (proto.version() > FluxFileVersion::VERSION_3)
         error(
             "this is a version {} flux file, but this build of the client can "
             "only handle up to version {} --- please upgrade",
             (int)proto.version(),
-            (int)FluxFileVersion::VERSION_2);
+            (int)FluxFileVersion::VERSION_3);
 }
 
-FluxFileProto loadFl2File(const std::string filename)
+/* Merges track records which refer to the same track, in file order. */
+
+static void mergeDuplicateTracks(FluxFileProto& proto)
 {
-    std::ifstream ifs(filename, std::ios::in | std::ios::binary);
-    if (!ifs.is_open())
-        error("cannot open input file '{}': {}", filename, strerror(errno));
+    std::map<std::pair<int, int>, TrackFluxProto*> tracks;
+    google::protobuf::RepeatedPtrField<TrackFluxProto> merged;
+    for (auto& track : *proto.mutable_track())
+    {
+        auto& t = tracks[std::make_pair(track.track(), track.head())];
+        if (!t)
+        {
+            t = merged.Add();
+            t->Swap(&track);
+        }
+        else
+        {
+            for (auto& flux : *track.mutable_flux())
+                t->add_flux(std::move(flux));
+            for (const auto& chunk : track.chunk())
+                *t->add_chunk() = chunk;
+        }
+    }
+    proto.mutable_track()->Swap(&merged);
+}
 
-    char buffer[16];
-    ifs.read(buffer, sizeof(buffer));
-    if (strncmp(buffer, "SQLite format 3", 16) == 0)
-        error(
-            "this flux file is too old; please use the upgrade-flux-file tool "
-            "to upgrade it");
+/* Returns the length of the longest prefix of the file consisting of complete
+ * top-level fields. This lets files which were never completed be read. */
 
-    FluxFileProto proto;
-    ifs.seekg(0);
-    if (!proto.ParseFromIstream(&ifs))
-        error("unable to read input file '{}'", filename);
-    upgradeFluxFile(proto);
+static size_t findCompletePrefix(const Bytes& data)
+{
+    google::protobuf::io::CodedInputStream cis(data.cbegin(), data.size());
+    size_t length = 0;
+    for (;;)
+    {
+        uint32_t tag = cis.ReadTag();
+        if (!tag || !google::protobuf::internal::WireFormatLite::SkipField(
+                        &cis, tag))
+            break;
+        length = cis.CurrentPosition();
+    }
+    return length;
+}
+
+static void writeVarint(std::ostream& os, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        os.put((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    os.put(value);
+}
+
+static void writeField(std::ostream& os, int field, const std::string& data)
+{
+    writeVarint(os, (field << 3) | 2);
+    writeVarint(os, data.size());
+    os.write(data.data(), data.size());
+}
+
+FluxFileProto loadFl2File(const std::string filename)
+{
+    Fl2FileReader reader(filename);
+    FluxFileProto proto = reader.proto();
+    upgradeFluxFile(proto,
+        [&](const FluxChunkProto& chunk)
+        {
+            TrackFluxProto track;
+            *track.add_chunk() = chunk;
+            return reader.readFlux(track, 0);
+        });
     return proto;
 }
 
 void saveFl2File(const std::string filename, FluxFileProto& proto)
 {
     proto.set_magic(FluxMagic::MAGIC);
-    proto.set_version(FluxFileVersion::VERSION_2);
+    if (proto.version() != FluxFileVersion::VERSION_3)
+        proto.set_version(FluxFileVersion::VERSION_2);
 
+    if (proto.version() == FluxFileVersion::VERSION_3)
+    {
+        Fl2FileWriter writer(
+            filename, FluxFileVersion::VERSION_3, proto.flux_encoding());
+        for (const auto& track : proto.track())
+            for (const auto& flux : track.flux())
+                writer.writeFlux(track.track(), track.head(), flux);
+        writer.close(proto);
+        return;
+    }
+
+    /* In-memory flux is always bytecode. */
+
+    proto.clear_flux_encoding();
     std::ofstream of(filename, std::ios::out | std::ios::binary);
     if (!proto.SerializeToOstream(&of))
         error("unable to write output file '{}'", filename);
@@ -67,3 +163,241 @@ void saveFl2File(const std::string filename, FluxFileProto& proto)
     if (of.fail())
         error("FL2 write I/O error: {}", strerror(errno));
 }
+
+Fl2FileWriter::Fl2FileWriter(const std::string& filename,
+    FluxFileVersion version,
+    FluxEncoding encoding):
+    _filename(filename),
+    _version(version)
+{
+    if ((encoding != FLUXENCODING_BYTECODE) &&
+        (version != FluxFileVersion::VERSION_3))
+        error("compact flux can only be written to version 3 FL2 files");
+
+    _of.open(filename, std::ios::out | std::ios::binary);
+    if (!_of.is_open())
+        error("cannot open output file '{}': {}", filename, strerror(errno));
+
+    _index.set_magic(FluxMagic::MAGIC);
+    _index.set_version(_version);
+    if (encoding != FLUXENCODING_BYTECODE)
+        _index.set_flux_encoding(encoding);
+    if (!_index.SerializeToOstream(&_of))
+        error("unable to write output file '{}'", filename);
+}
+
+Fl2FileWriter::~Fl2FileWriter() {}
+
+void Fl2FileWriter::writeFlux(int track, int head, const Bytes& flux)
+{
+    if (_version == FluxFileVersion::VERSION_3)
+    {
+        /* Each chunk is followed by a record saying which track it belongs
+         * to; these are only read if the index never gets written. */
+
+        Bytes compressed =
+            (_index.flux_encoding() == FLUXENCODING_COMPACT)
+                ? Fluxmap(flux).compactBytes().compress()
+                : flux.compress();
+        writeVarint(_of, (FluxFileProto::kChunkDataFieldNumber << 3) | 2);
+        writeVarint(_of, compressed.size());
+
+        auto& indexTrack = _indexTracks[std::make_pair(track, head)];
+        if (!indexTrack)
+        {
+            indexTrack = _index.add_track();
+            indexTrack->set_track(track);
+            indexTrack->set_head(head);
+        }
+        auto* chunk = indexTrack->add_chunk();
+        chunk->set_offset(_of.tellp());
+        chunk->set_length(compressed.size());
+        _of.write((const char*)compressed.cbegin(), compressed.size());
+
+        TrackFluxProto partial;
+        partial.set_track(track);
+        partial.set_head(head);
+        *partial.add_chunk() = *chunk;
+        writeField(_of,
+            FluxFileProto::kPartialTrackFieldNumber,
+            partial.SerializeAsString());
+        checkForError();
+    }
+    else
+    {
+        /* Version 2 files hold a track record per run of flux for the same
+         * track, so only the current track is kept in memory. */
+
+        if (_current.flux_size() &&
+            ((_current.track() != track) || (_current.head() != head)))
+            flushTrack();
+
+        _current.set_track(track);
+        _current.set_head(head);
+        _current.add_flux(flux);
+    }
+}
+
+void Fl2FileWriter::flushTrack()
+{
+    if (!_current.flux_size())
+        return;
+
+    writeField(_of,
+        FluxFileProto::kTrackFieldNumber,
+        _current.SerializeAsString());
+    _current.Clear();
+    checkForError();
+}
+
+void Fl2FileWriter::close(const FluxFileProto& metadata)
+{
+    flushTrack();
+
+    FluxFileProto trailer;
+    if (metadata.has_rotational_period_ms())
+        trailer.set_rotational_period_ms(metadata.rotational_period_ms());
+    if (metadata.has_drive_type())
+        trailer.set_drive_type(metadata.drive_type());
+    if (metadata.has_format_type())
+        trailer.set_format_type(metadata.format_type());
+
+    if (_version == FluxFileVersion::VERSION_3)
+    {
+        uint64_t indexOffset = _of.tellp();
+        _index.MergeFrom(trailer);
+        if (!_index.SerializeToOstream(&_of))
+            error("unable to write output file '{}'", _filename);
+
+        _of.put(INDEX_OFFSET_TAG);
+        for (int i = 0; i < 8; i++)
+            _of.put(indexOffset >> (i * 8));
+    }
+    else if (!trailer.SerializeToOstream(&_of))
+        error("unable to write output file '{}'", _filename);
+
+    _of.close();
+    if (_of.fail())
+        error("FL2 write I/O error: {}", strerror(errno));
+}
+
+void Fl2FileWriter::checkForError()
+{
+    _of.flush();
+    if (_of.fail())
+        error("FL2 write I/O error: {}", strerror(errno));
+}
+
+Fl2FileReader::Fl2FileReader(const std::string& filename):
+    _filename(filename),
+    _ifs(filename, std::ios::in | std::ios::binary)
+{
+    if (!_ifs.is_open())
+        error("cannot open input file '{}': {}", filename, strerror(errno));
+
+    char buffer[16] = {};
+    _ifs.read(buffer, sizeof(buffer));
+    if (strncmp(buffer, "SQLite format 3", 16) == 0)
+        error(
+            "this flux file is too old; please use the upgrade-flux-file tool "
+            "to upgrade it");
+
+    /* Version 3 files end with the offset of the index; if it's there, that's
+     * all that needs reading. */
+
+    _ifs.clear();
+    _ifs.seekg(0, std::ios::end);
+    uint64_t fileSize = _ifs.tellg();
+    bool indexed = false;
+    if (fileSize >= FOOTER_SIZE)
+    {
+        Bytes footer(FOOTER_SIZE);
+        _ifs.seekg(fileSize - FOOTER_SIZE);
+        _ifs.read((char*)footer.begin(), FOOTER_SIZE);
+        ByteReader br(footer);
+        uint8_t tag = br.read_8();
+        uint64_t indexOffset = br.read_le32();
+        indexOffset |= (uint64_t)br.read_le32() << 32;
+        if ((tag == INDEX_OFFSET_TAG) &&
+            (indexOffset < (fileSize - FOOTER_SIZE)))
+        {
+            Bytes index(fileSize - FOOTER_SIZE - indexOffset);
+            _ifs.seekg(indexOffset);
+            _ifs.read((char*)index.begin(), index.size());
+            indexed = _proto.ParseFromArray(index.cbegin(), index.size()) &&
+                      (_proto.magic() == FluxMagic::MAGIC) &&
+                      (_proto.version() == FluxFileVersion::VERSION_3);
+        }
+    }
+
+    if (!indexed)
+    {
+        _ifs.clear();
+        _ifs.seekg(0);
+        _proto.Clear();
+        if (!_proto.ParseFromIstream(&_ifs))
+        {
+            /* The file may have been left incomplete by a crash; read as much
+             * of it as possible. */
+
+            Bytes data = Bytes::readFromFile(filename);
+            _proto.Clear();
+            size_t length = findCompletePrefix(data);
+            if (!length || !_proto.ParseFromArray(data.cbegin(), length))
+                error("unable to read input file '{}'", filename);
+        }
+        if (_proto.magic() != FluxMagic::MAGIC)
+            error("unable to read input file '{}'", filename);
+        _proto.clear_chunk_data();
+
+        /* Version 3 files without an index have their tracks rebuilt from the
+         * records written alongside the chunks. */
+
+        if (_proto.track_size() == 0)
+            _proto.mutable_track()->Swap(_proto.mutable_partial_track());
+        _proto.clear_partial_track();
+        mergeDuplicateTracks(_proto);
+
+        if (_proto.version() != FluxFileVersion::VERSION_3)
+            upgradeFluxFile(_proto, nullptr);
+    }
+
+    for (const auto& track : _proto.track())
+        _tracks[std::make_pair(track.track(), track.head())] = &track;
+}
+
+Fl2FileReader::~Fl2FileReader() {}
+
+const TrackFluxProto* Fl2FileReader::findTrack(int track, int head) const
+{
+    auto it = _tracks.find(std::make_pair(track, head));
+    if (it == _tracks.end())
+        return nullptr;
+    return it->second;
+}
+
+int Fl2FileReader::fluxCount(const TrackFluxProto& track) const
+{
+    return track.flux_size() + track.chunk_size();
+}
+
+Bytes Fl2FileReader::readFlux(const TrackFluxProto& track, int index)
+{
+    if (index < track.flux_size())
+        return track.flux(index);
+
+    const auto& chunk = track.chunk(index - track.flux_size());
+    Bytes compressed(chunk.length());
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _ifs.clear();
+        _ifs.seekg(chunk.offset());
+        _ifs.read((char*)compressed.begin(), compressed.size());
+        if (_ifs.fail())
+            error("FL2 read I/O error: {}", strerror(errno));
+    }
+    Bytes data = compressed.decompress();
+    if (_proto.flux_encoding() == FLUXENCODING_COMPACT)
+        return Fluxmap().appendCompactBytes(data).rawBytes();
+    return data;
+}
@@ -1,9 +1,76 @@
 #ifndef FL2_H
 #define FL2_H
 
-class FluxFileProto;
+#include "lib/fl2.pb.h"
+#include <fstream>
+#include <mutex>
 
 extern FluxFileProto loadFl2File(const std::string filename);
 extern void saveFl2File(const std::string filename, FluxFileProto& proto);
 
+/* Writes an FL2 file as the flux arrives, keeping at most one track in
+ * memory; close() writes the metadata (and, for version 3 files, the index).
+ * Files which are never closed can still be read up to the last complete
+ * track. */
+
+class Fl2FileWriter
+{
+public:
+    Fl2FileWriter(const std::string& filename,
+        FluxFileVersion version,
+        FluxEncoding encoding = FLUXENCODING_BYTECODE);
+    ~Fl2FileWriter();
+
+public:
+    void writeFlux(int track, int head, const Bytes& flux);
+
+    /* Only the rotational period, drive type and format type of the
+     * metadata are used. */
+    void close(const FluxFileProto& metadata);
+
+private:
+    void flushTrack();
+    void checkForError();
+
+private:
+    std::string _filename;
+    FluxFileVersion _version;
+    std::ofstream _of;
+    FluxFileProto _index;
+    TrackFluxProto _current;
+    std::map<std::pair<int, int>, TrackFluxProto*> _indexTracks;
+};
+
+/* Random access to the tracks of an FL2 file. For indexed (version 3) files
+ * only the index is read on opening, and each flux is read and decompressed
+ * when it's asked for; older files are loaded in full. */
+
+class Fl2FileReader
+{
+public:
+    Fl2FileReader(const std::string& filename);
+    ~Fl2FileReader();
+
+public:
+    /* The file's metadata; for version 3 files the tracks contain chunk
+     * references rather than flux. */
+    const FluxFileProto& proto() const
+    {
+        return _proto;
+    }
+
+    /* Returns nullptr if the track isn't in the file. */
+    const TrackFluxProto* findTrack(int track, int head) const;
+
+    int fluxCount(const TrackFluxProto& track) const;
+    Bytes readFlux(const TrackFluxProto& track, int index);
+
+private:
+    std::string _filename;
+    std::ifstream _ifs;
+    std::mutex _mutex;
+    FluxFileProto _proto;
+    std::map<std::pair<int, int>, const TrackFluxProto*> _tracks;
+};
+
 #endif
@@ -30,6 +30,15 @@ struct TrackFlux
     std::shared_ptr<const TrackInfo> trackInfo;
     std::vector<std::shared_ptr<TrackDataFlux>> trackDatas;
     std::set<std::shared_ptr<const Sector>> sectors;
+
+    /* The same sectors indexed by location, so that new reads can be merged
+     * in without revisiting old ones; along with how many of trackDatas have
+     * been merged and how many of the sectors aren't OK. */
+
+    std::map<std::tuple<int, int, int>, std::shared_ptr<const Sector>>
+        sectorsByLocation;
+    unsigned mergedTrackDatas = 0;
+    unsigned badSectors = 0;
 };
 
 struct DiskFlux
@@ -2,38 +2,317 @@
 #include "lib/fluxmap.h"
 #include "lib/decoders/fluxmapreader.h"
 #include "protocol.h"
+#include <mutex>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define FLUXMAP_HAVE_SSE2
+#endif
+
+/* Sums the intervals in a run of bytecode. With SSE2, PSADBW adds up sixteen
+ * masked bytes at a time; otherwise, and for the tail, eight bytes are summed
+ * in a 64-bit word by folding pairs of bytes into 16-bit lanes. */
+
+static uint32_t countTicks(const uint8_t* ptr, size_t len)
+{
+    uint64_t ticks = 0;
+
+#if defined(FLUXMAP_HAVE_SSE2)
+    const __m128i mask = _mm_set1_epi8(0x3f);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    while (len >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)ptr);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_and_si128(v, mask), zero));
+        ptr += 16;
+        len -= 16;
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, sum);
+    ticks += lanes[0] + lanes[1];
+#endif
+
+    while (len >= 8)
+    {
+        uint64_t w;
+        memcpy(&w, ptr, sizeof(w));
+        w &= 0x3f3f3f3f3f3f3f3fULL;
+        w = (w & 0x00ff00ff00ff00ffULL) + ((w >> 8) & 0x00ff00ff00ff00ffULL);
+        ticks += (w * 0x0001000100010001ULL) >> 48;
+        ptr += 8;
+        len -= 8;
+    }
+
+    while (len--)
+        ticks += *ptr++ & 0x3f;
+    return ticks;
+}
 
 Fluxmap& Fluxmap::appendBytes(const Bytes& bytes)
 {
     if (bytes.size() == 0)
         return *this;
+    expand();
+
+    /* An empty fluxmap can share the caller's buffer rather than copying it;
+     * Bytes is copy-on-write, so appending later won't affect the caller. */
+
+    if (_bytes.empty())
+    {
+        invalidateEventIndex();
+        _bytes = bytes;
+        _ticks = countTicks(_bytes.cbegin(), _bytes.size());
+        _duration = _ticks * NS_PER_TICK;
+        return *this;
+    }
 
     return appendBytes(&bytes[0], bytes.size());
 }
 
 Fluxmap& Fluxmap::appendBytes(const uint8_t* ptr, size_t len)
 {
-    ByteWriter bw(_bytes);
-    bw.seekToEnd();
+    if (len == 0)
+        return *this;
 
-    while (len--)
-    {
-        uint8_t byte = *ptr++;
-        _ticks += byte & 0x3f;
-        bw.write_8(byte);
-    }
+    expand();
+    invalidateEventIndex();
+    unsigned oldSize = _bytes.size();
+    _bytes.resize(oldSize + len);
+    memcpy(_bytes.begin() + oldSize, ptr, len);
 
+    _ticks += countTicks(ptr, len);
     _duration = _ticks * NS_PER_TICK;
     return *this;
 }
 
+/* In the compact form, COMPACT_RUN is followed by a varint; zero means a
+ * literal COMPACT_RUN byte, and anything else is the length of a run of
+ * FILLER bytes. appendInterval() never produces COMPACT_RUN (an event byte
+ * with a full interval), so the escape is almost never needed. */
+
+static constexpr uint8_t FILLER = 0x3f;
+static constexpr uint8_t COMPACT_RUN = F_BIT_PULSE | F_BIT_INDEX | 0x3f;
+static constexpr size_t MIN_COMPACT_RUN = 3;
+
+Bytes Fluxmap::compactBytes() const
+{
+    if (isCompact())
+        return _compact;
+
+    auto output = std::make_shared<std::vector<uint8_t>>();
+    output->reserve(_bytes.size());
+
+    auto writeVarint = [&](size_t value)
+    {
+        while (value >= 0x80)
+        {
+            output->push_back((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        output->push_back(value);
+    };
+
+    const uint8_t* p = _bytes.cbegin();
+    const uint8_t* end = _bytes.cend();
+    while (p != end)
+    {
+        uint8_t b = *p;
+        if (b == FILLER)
+        {
+            const uint8_t* q = std::find_if(p,
+                end,
+                [](uint8_t c)
+                {
+                    return c != FILLER;
+                });
+            size_t run = q - p;
+            if (run >= MIN_COMPACT_RUN)
+            {
+                output->push_back(COMPACT_RUN);
+                writeVarint(run);
+            }
+            else
+                output->insert(output->end(), p, q);
+            p = q;
+        }
+        else
+        {
+            output->push_back(b);
+            if (b == COMPACT_RUN)
+                writeVarint(0);
+            p++;
+        }
+    }
+
+    return Bytes(output);
+}
+
+static Bytes expandCompactBytes(const Bytes& compact)
+{
+    auto output = std::make_shared<std::vector<uint8_t>>();
+    output->reserve(compact.size());
+
+    const uint8_t* p = compact.cbegin();
+    const uint8_t* end = compact.cend();
+    while (p != end)
+    {
+        uint8_t b = *p++;
+        if (b != COMPACT_RUN)
+        {
+            output->push_back(b);
+            continue;
+        }
+
+        size_t run = 0;
+        int shift = 0;
+        for (;;)
+        {
+            if ((p == end) || (shift > 56))
+                error("corrupt compact flux data");
+            uint8_t v = *p++;
+            run |= (size_t)(v & 0x7f) << shift;
+            shift += 7;
+            if (!(v & 0x80))
+                break;
+        }
+
+        if (run > (UINT_MAX - output->size()))
+            error("corrupt compact flux data");
+        if (run == 0)
+            output->push_back(COMPACT_RUN);
+        else
+            output->insert(output->end(), run, FILLER);
+    }
+
+    return Bytes(output);
+}
+
+Fluxmap& Fluxmap::appendCompactBytes(const Bytes& compact)
+{
+    return appendBytes(expandCompactBytes(compact));
+}
+
+std::unique_ptr<const Fluxmap> Fluxmap::compacted() const
+{
+    if (isCompact())
+        return nullptr;
+
+    /* Reading a compact fluxmap costs an expansion, so it's only worth it if
+     * it at least halves the size; ordinary data barely shrinks at all. Only
+     * filler bytes can be removed, so counting them rules most flux out
+     * without building the compact form. */
+
+    size_t fillers = std::count(_bytes.cbegin(), _bytes.cend(), FILLER);
+    if (fillers < ((_bytes.size() + 1) / 2))
+        return nullptr;
+
+    Bytes compact = compactBytes();
+    if (compact.size() > (_bytes.size() / 2))
+        return nullptr;
+
+    auto fluxmap = std::make_unique<Fluxmap>();
+    fluxmap->_compact = compact;
+    fluxmap->_compactLength = _bytes.size();
+    fluxmap->_ticks = _ticks;
+    fluxmap->_duration = _duration;
+    return fluxmap;
+}
+
+Bytes Fluxmap::rawBytes() const
+{
+    if (isCompact())
+        return expandCompactBytes(_compact);
+    return _bytes;
+}
+
+void Fluxmap::expand()
+{
+    if (!isCompact())
+        return;
+
+    invalidateEventIndex();
+    _bytes = expandCompactBytes(_compact);
+    _compact = Bytes();
+    _compactLength = 0;
+}
+
 uint8_t& Fluxmap::findLastByte()
 {
+    expand();
     if (_bytes.empty())
         appendByte(0x00);
+    invalidateEventIndex();
     return *(_bytes.end() - 1);
 }
 
+/* Guards every fluxmap's _eventIndex; it's only taken when a reader is
+ * created, so there's no point having one per fluxmap. */
+
+static std::mutex eventIndexMutex;
+
+void Fluxmap::invalidateEventIndex()
+{
+    /* Modifying a fluxmap while it's being read is already unsafe, so this
+     * doesn't need the lock. */
+
+    _eventIndex.reset();
+}
+
+std::shared_ptr<const Fluxmap::EventIndex> Fluxmap::eventIndex() const
+{
+    {
+        std::lock_guard<std::mutex> lock(eventIndexMutex);
+        auto index = _eventIndex.lock();
+        if (index)
+            return index;
+    }
+
+    /* The index is built without holding the lock so that threads reading
+     * different fluxmaps don't wait for each other. */
+
+    auto events = std::make_shared<EventIndex>();
+    events->bytecode = rawBytes();
+    const uint8_t* bytes = events->bytecode.cbegin();
+    size_t size = events->bytecode.size();
+
+    /* Most bytes are events, so this is a reasonable guess. */
+
+    events->intervals.reserve(size);
+    events->offsets.reserve(size);
+
+    uint32_t ticks = 0;
+    uint32_t totalTicks = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        uint8_t b = bytes[i];
+        ticks += b & 0x3f;
+        if (!b || (b & (F_BIT_PULSE | F_BIT_INDEX)))
+        {
+            if (b & F_BIT_INDEX)
+                events->indexEvents.push_back(events->intervals.size());
+            events->intervals.push_back(ticks);
+            events->offsets.push_back(i + 1);
+            totalTicks += ticks;
+            ticks = 0;
+
+            if ((events->size() % EventIndex::CHECKPOINT_INTERVAL) == 0)
+                events->checkpointTicks.push_back(totalTicks);
+        }
+    }
+    events->trailingTicks = ticks;
+
+    /* If another thread got there first, use its copy so that there's only
+     * ever one. */
+
+    std::lock_guard<std::mutex> lock(eventIndexMutex);
+    auto index = _eventIndex.lock();
+    if (index)
+        return index;
+    _eventIndex = events;
+    return events;
+}
+
 Fluxmap& Fluxmap::appendInterval(uint32_t ticks)
 {
     while (ticks >= 0x3f)
@@ -63,6 +342,8 @@ Fluxmap& Fluxmap::appendDesync()
     return *this;
 }
 
+/* Each of the returned fluxmaps is a view onto this one's bytecode. */
+
 std::vector<std::unique_ptr<const Fluxmap>> Fluxmap::split() const
 {
     std::vector<std::unique_ptr<const Fluxmap>> maps;
@@ -35,7 +35,9 @@ public:
         appendBytes((const uint8_t*)s.c_str(), s.size());
     }
 
-    Fluxmap(const Bytes bytes)
+    /* Wraps the bytecode without copying it. */
+
+    Fluxmap(const Bytes& bytes)
     {
         appendBytes(bytes);
     }
@@ -50,15 +52,16 @@ public:
     }
     size_t bytes() const
     {
-        return _bytes.size();
-    }
-    const Bytes& rawBytes() const
-    {
-        return _bytes;
+        return isCompact() ? _compactLength : _bytes.size();
     }
 
+    /* If the fluxmap is stored compactly, this has to expand it. */
+    Bytes rawBytes() const;
+
+    /* Only valid for fluxmaps which aren't stored compactly. */
     const uint8_t* ptr() const
     {
+        assert(!isCompact());
         if (!_bytes.empty())
             return &_bytes[0];
         return NULL;
@@ -79,6 +82,25 @@ public:
 
     Fluxmap& appendBits(const std::vector<bool>& bits, nanoseconds_t clock);
 
+    /* A lossless alternative to the bytecode for storage, in which long runs
+     * of filler bytes (i.e. long gaps between pulses) are replaced with a
+     * count. Ordinary intervals still take a byte each. */
+
+    Bytes compactBytes() const;
+    Fluxmap& appendCompactBytes(const Bytes& compact);
+
+    /* Returns a copy of this fluxmap which holds the compact form in memory
+     * instead of the bytecode, or nullptr if that wouldn't save much. It
+     * behaves exactly the same, but each FluxmapReader has to expand it
+     * again, and modifying it turns it back into bytecode. */
+
+    std::unique_ptr<const Fluxmap> compacted() const;
+
+    bool isCompact() const
+    {
+        return !_compact.empty();
+    }
+
     std::unique_ptr<const Fluxmap> precompensate(
         int threshold_ticks, int amount_ticks);
     std::vector<std::unique_ptr<const Fluxmap>> split() const;
@@ -96,13 +118,58 @@ public:
     ClockData guessClock(
         double noiseFloorFactor = 0.01, double signalLevelFactor = 0.05) const;
 
+    /* A decoded view of the bytecode, with one entry per event (that is, each
+     * byte which is a pulse, an index or a desync); FluxmapReader iterates over
+     * this rather than the raw bytes. It's several times the size of the
+     * bytecode, so the fluxmap only keeps a weak reference to it: it's shared
+     * by everything reading the fluxmap at the same time, and freed once
+     * they've all finished. */
+
+    struct EventIndex
+    {
+        /* The bytecode the index refers to; for a compact fluxmap, this is
+         * the only expanded copy. */
+        Bytes bytecode;
+
+        /* Ticks since the previous event. */
+        std::vector<uint32_t> intervals;
+
+        /* Byte offset just past each event; the event bits (F_BIT_PULSE,
+         * F_BIT_INDEX or F_DESYNC) are in the byte before it. */
+        std::vector<uint32_t> offsets;
+
+        /* Event numbers of all the index pulses. */
+        std::vector<uint32_t> indexEvents;
+
+        /* Ticks between the last event and the end of the bytecode. */
+        uint32_t trailingTicks = 0;
+
+        /* Total ticks from the start of the fluxmap to the end of every
+         * CHECKPOINT_INTERVAL'th event: entry k is for the end of event
+         * (k + 1) * CHECKPOINT_INTERVAL - 1. Seeks binary search this. */
+        static constexpr unsigned CHECKPOINT_INTERVAL = 64;
+        std::vector<uint32_t> checkpointTicks;
+
+        size_t size() const
+        {
+            return intervals.size();
+        }
+    };
+
+    std::shared_ptr<const EventIndex> eventIndex() const;
+
 private:
     uint8_t& findLastByte();
+    void invalidateEventIndex();
+    void expand();
 
 private:
     nanoseconds_t _duration = 0;
     int _ticks = 0;
     Bytes _bytes;
+    Bytes _compact;              /* if set, used instead of _bytes */
+    unsigned _compactLength = 0; /* the bytecode length of _compact */
+    mutable std::weak_ptr<const EventIndex> _eventIndex;
 };
 
 #endif
@@ -18,43 +18,33 @@ class Fl2FluxSink : public FluxSink
 {
 public:
     Fl2FluxSink(const Fl2FluxSinkProto& lconfig):
-        Fl2FluxSink(lconfig.filename())
+        Fl2FluxSink(
+            lconfig.filename(), lconfig.version(), lconfig.flux_encoding())
     {
     }
 
-    Fl2FluxSink(const std::string& filename): _filename(filename)
+    Fl2FluxSink(const std::string& filename,
+        FluxFileVersion version = FluxFileVersion::VERSION_2,
+        FluxEncoding encoding = FLUXENCODING_BYTECODE):
+        _filename(filename),
+        _writer(filename, version, encoding)
     {
-        std::ofstream of(filename);
-        if (!of.is_open())
-            error("cannot open output file");
-        of.close();
-        std::filesystem::remove(filename);
     }
 
     ~Fl2FluxSink()
     {
-        FluxFileProto proto;
-        for (const auto& e : _data)
-        {
-            auto track = proto.add_track();
-            track->set_track(e.first.first);
-            track->set_head(e.first.second);
-            for (const auto& fluxBytes : e.second)
-                track->add_flux(fluxBytes);
-        }
-
-        proto.set_rotational_period_ms(
+        FluxFileProto metadata;
+        metadata.set_rotational_period_ms(
             globalConfig()->drive().rotational_period_ms());
-        proto.set_drive_type(globalConfig()->drive().drive_type());
-        proto.set_format_type(globalConfig()->layout().format_type());
-        saveFl2File(_filename, proto);
+        metadata.set_drive_type(globalConfig()->drive().drive_type());
+        metadata.set_format_type(globalConfig()->layout().format_type());
+        _writer.close(metadata);
     }
 
 public:
     void writeFlux(int track, int head, const Fluxmap& fluxmap) override
     {
-        auto& vector = _data[std::make_pair(track, head)];
-        vector.push_back(fluxmap.rawBytes());
+        _writer.writeFlux(track, head, fluxmap.rawBytes());
     }
 
     operator std::string() const override
@@ -64,7 +54,7 @@ public:
 
 private:
     std::string _filename;
-    std::map<std::pair<unsigned, unsigned>, std::vector<Bytes>> _data;
+    Fl2FileWriter _writer;
 };
 
 std::unique_ptr<FluxSink> FluxSink::createFl2FluxSink(
@@ -11,21 +11,26 @@
 class Fl2FluxSourceIterator : public FluxSourceIterator
 {
 public:
-    Fl2FluxSourceIterator(const TrackFluxProto& proto): _proto(proto) {}
+    Fl2FluxSourceIterator(Fl2FileReader& reader, const TrackFluxProto& proto):
+        _reader(reader),
+        _proto(proto)
+    {
+    }
 
     bool hasNext() const override
     {
-        return _count < _proto.flux_size();
+        return _count < _reader.fluxCount(_proto);
     }
 
     std::unique_ptr<const Fluxmap> next() override
     {
-        auto bytes = _proto.flux(_count);
+        auto bytes = _reader.readFlux(_proto, _count);
         _count++;
         return std::make_unique<Fluxmap>(bytes);
     }
 
 private:
+    Fl2FileReader& _reader;
     const TrackFluxProto& _proto;
     int _count = 0;
 };
@@ -33,40 +38,33 @@ private:
 class Fl2FluxSource : public FluxSource
 {
 public:
-    Fl2FluxSource(const Fl2FluxSourceProto& config): _config(config)
+    Fl2FluxSource(const Fl2FluxSourceProto& config):
+        _config(config),
+        _reader(_config.filename())
     {
-        _proto = loadFl2File(_config.filename());
-
+        const auto& proto = _reader.proto();
         _extraConfig.mutable_drive()->set_rotational_period_ms(
-            _proto.rotational_period_ms());
-        if (_proto.has_drive_type())
-            _extraConfig.mutable_drive()->set_drive_type(_proto.drive_type());
+            proto.rotational_period_ms());
+        if (proto.has_drive_type())
+            _extraConfig.mutable_drive()->set_drive_type(proto.drive_type());
     }
 
 public:
     std::unique_ptr<FluxSourceIterator> readFlux(int track, int head) override
     {
-        for (const auto& trackFlux : _proto.track())
-        {
-            if ((trackFlux.track() == track) && (trackFlux.head() == head))
-                return std::make_unique<Fl2FluxSourceIterator>(trackFlux);
-        }
+        const auto* trackFlux = _reader.findTrack(track, head);
+        if (trackFlux)
+            return std::make_unique<Fl2FluxSourceIterator>(
+                _reader, *trackFlux);
 
         return std::make_unique<EmptyFluxSourceIterator>();
     }
 
     void recalibrate() override {}
 
-private:
-    void check_for_error(std::ifstream& ifs)
-    {
-        if (ifs.fail())
-            error("FL2 read I/O error: {}", strerror(errno));
-    }
-
 private:
     const Fl2FluxSourceProto& _config;
-    FluxFileProto _proto;
+    Fl2FileReader _reader;
 };
 
 std::unique_ptr<FluxSource> FluxSource::createFl2FluxSource(
@@ -25,6 +25,14 @@ public:
 
     virtual bool hasNext() const = 0;
     virtual std::unique_ptr<const Fluxmap> next() = 0;
+
+    /* Whether the flux last returned by next() was deliberately cut short. If
+     * it doesn't decode cleanly, calling next() again will get the rest. */
+
+    virtual bool wasShortRead() const
+    {
+        return false;
+    }
 };
 
 class FluxSource
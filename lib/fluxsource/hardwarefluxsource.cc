@@ -29,22 +29,39 @@ private:
         {
             const auto& drive = globalConfig()->drive();
 
+            /* Most tracks decode cleanly from a single revolution, so if
+             * asked to, start with a short read and only do the full number
+             * of revolutions if that wasn't enough. */
+
+            double revolutions = drive.revolutions();
+            _shortRead = (_reads++ == 0) && drive.first_read_revolutions() &&
+                         (drive.first_read_revolutions() < revolutions);
+            if (_shortRead)
+                revolutions = drive.first_read_revolutions();
+
             usbSetDrive(
                 drive.drive(), drive.high_density(), drive.index_mode());
             usbSeek(_track);
 
             Bytes data = usbRead(_head,
                 drive.sync_with_index(),
-                drive.revolutions() * drive.rotational_period_ms() * 1e6,
+                revolutions * drive.rotational_period_ms() * 1e6,
                 drive.hard_sector_threshold_ns());
             auto fluxmap = std::make_unique<Fluxmap>();
             fluxmap->appendBytes(data);
             return fluxmap;
         }
 
+        bool wasShortRead() const override
+        {
+            return _shortRead;
+        }
+
     private:
         int _track;
         int _head;
+        unsigned _reads = 0;
+        bool _shortRead = false;
     };
 
 public:
@@ -3,6 +3,7 @@
 #include "lib/proto.h"
 #include "lib/logger.h"
 #include "lib/fl2.h"
+#include <mutex>
 
 static unsigned getTrackStep()
 {
@@ -186,7 +187,7 @@ std::vector<unsigned> Layout::expandSectorList(
     return sectors;
 }
 
-std::shared_ptr<const TrackInfo> Layout::getLayoutOfTrack(
+static std::shared_ptr<const TrackInfo> computeLayoutOfTrack(
     unsigned logicalTrack, unsigned logicalSide)
 {
     auto trackInfo = std::make_shared<TrackInfo>();
@@ -211,11 +212,13 @@ std::shared_ptr<const TrackInfo> Layout::getLayoutOfTrack(
     trackInfo->sectorSize = layoutdata.sector_size();
     trackInfo->logicalTrack = logicalTrack;
     trackInfo->logicalSide = logicalSide;
-    trackInfo->physicalTrack = remapTrackLogicalToPhysical(logicalTrack);
+    trackInfo->physicalTrack =
+        Layout::remapTrackLogicalToPhysical(logicalTrack);
     trackInfo->physicalSide =
         logicalSide ^ globalConfig()->layout().swap_sides();
     trackInfo->groupSize = getTrackStep();
-    trackInfo->diskSectorOrder = expandSectorList(layoutdata.physical());
+    trackInfo->diskSectorOrder =
+        Layout::expandSectorList(layoutdata.physical());
     trackInfo->naturalSectorOrder = trackInfo->diskSectorOrder;
     std::sort(trackInfo->naturalSectorOrder.begin(),
         trackInfo->naturalSectorOrder.end());
@@ -224,7 +227,7 @@ std::shared_ptr<const TrackInfo> Layout::getLayoutOfTrack(
     if (layoutdata.has_filesystem())
     {
         trackInfo->filesystemSectorOrder =
-            expandSectorList(layoutdata.filesystem());
+            Layout::expandSectorList(layoutdata.filesystem());
         if (trackInfo->filesystemSectorOrder.size() != trackInfo->numSectors)
             error(
                 "filesystem sector order list doesn't contain the right "
@@ -244,6 +247,73 @@ std::shared_ptr<const TrackInfo> Layout::getLayoutOfTrack(
     return trackInfo;
 }
 
+/* TrackInfos are immutable, so they're computed once per config and shared.
+ * The table covers the tracks and sides in the layout, and is filled in as
+ * tracks are asked for, so that any errors are reported at the same point as
+ * they would be otherwise. Anything outside the layout goes in a map. */
+
+namespace
+{
+    struct TrackInfoTable
+    {
+        unsigned generation;
+        unsigned tracks;
+        unsigned sides;
+        std::vector<std::shared_ptr<const TrackInfo>> entries;
+
+        std::mutex mutex;
+        std::map<std::pair<unsigned, unsigned>,
+            std::shared_ptr<const TrackInfo>>
+            others;
+    };
+}
+
+static std::shared_ptr<TrackInfoTable> trackInfoTable;
+
+static std::shared_ptr<TrackInfoTable> getTrackInfoTable()
+{
+    unsigned generation = globalConfig().generation();
+    auto table = std::atomic_load(&trackInfoTable);
+    if (table && (table->generation == generation))
+        return table;
+
+    table = std::make_shared<TrackInfoTable>();
+    table->tracks = globalConfig()->layout().tracks();
+    table->sides = globalConfig()->layout().sides();
+    table->entries.resize(table->tracks * table->sides);
+
+    /* Looking at the config may have rebuilt it. */
+
+    table->generation = globalConfig().generation();
+    std::atomic_store(&trackInfoTable, table);
+    return table;
+}
+
+std::shared_ptr<const TrackInfo> Layout::getLayoutOfTrack(
+    unsigned logicalTrack, unsigned logicalSide)
+{
+    auto table = getTrackInfoTable();
+    if ((logicalTrack < table->tracks) && (logicalSide < table->sides))
+    {
+        auto& entry =
+            table->entries[logicalTrack * table->sides + logicalSide];
+        auto trackInfo = std::atomic_load(&entry);
+        if (!trackInfo)
+        {
+            trackInfo = computeLayoutOfTrack(logicalTrack, logicalSide);
+            std::atomic_store(&entry, trackInfo);
+        }
+        return trackInfo;
+    }
+
+    std::lock_guard<std::mutex> lock(table->mutex);
+    auto& trackInfo =
+        table->others[std::make_pair(logicalTrack, logicalSide)];
+    if (!trackInfo)
+        trackInfo = computeLayoutOfTrack(logicalTrack, logicalSide);
+    return trackInfo;
+}
+
 std::shared_ptr<const TrackInfo> Layout::getLayoutOfTrackPhysical(
     unsigned physicalTrack, unsigned physicalSide)
 {
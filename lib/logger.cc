@@ -13,9 +13,15 @@ static std::function<void(std::shared_ptr<const AnyLogMessage>)> loggerImpl =
     std::cout << Logger::toString(*message) << std::flush;
 };
 
+static thread_local std::vector<std::shared_ptr<const AnyLogMessage>>*
+    capturedMessages = nullptr;
+
 void log(std::shared_ptr<const AnyLogMessage> message)
 {
-    loggerImpl(message);
+    if (capturedMessages)
+        capturedMessages->push_back(message);
+    else
+        loggerImpl(message);
 }
 
 void Logger::setLogger(
@@ -24,6 +30,18 @@ void Logger::setLogger(
     loggerImpl = cb;
 }
 
+Logger::Capture::Capture(
+    std::vector<std::shared_ptr<const AnyLogMessage>>& messages):
+    _previous(capturedMessages)
+{
+    capturedMessages = &messages;
+}
+
+Logger::Capture::~Capture()
+{
+    capturedMessages = _previous;
+}
+
 std::string Logger::toString(const AnyLogMessage& message)
 {
     std::stringstream stream;
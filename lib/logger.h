@@ -111,6 +111,21 @@ namespace Logger
         std::function<void(std::shared_ptr<const AnyLogMessage>)> cb);
 
     extern std::string toString(const AnyLogMessage&);
+
+    /* While one of these exists, messages logged on the current thread are
+     * appended to the supplied vector rather than being sent to the logger.
+     * This allows work done on a worker thread to have its messages replayed
+     * later, in order, on the main thread. */
+
+    class Capture
+    {
+    public:
+        Capture(std::vector<std::shared_ptr<const AnyLogMessage>>& messages);
+        ~Capture();
+
+    private:
+        std::vector<std::shared_ptr<const AnyLogMessage>>* _previous;
+    };
 }
 
 #endif
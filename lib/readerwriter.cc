@@ -15,9 +15,15 @@
 #include "lib/logger.h"
 #include "lib/layout.h"
 #include "lib/utils.h"
+#include "lib/calibration.h"
 #include "lib/config.pb.h"
 #include "lib/proto.h"
 #include <optional>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 enum ReadResult
 {
@@ -34,12 +40,46 @@ enum BadSectorsState
 
 /* In order to allow rereads in file-based flux sources, we need to persist the
  * FluxSourceIterator (as that's where the state for which read to return is
- * held). This class handles that. */
+ * held). This class handles that. Flux sources aren't thread safe, so if a
+ * mutex is supplied, all access to the underlying source is serialised through
+ * it. */
 
 class FluxSourceIteratorHolder
 {
 public:
-    FluxSourceIteratorHolder(FluxSource& fluxSource): _fluxSource(fluxSource) {}
+    FluxSourceIteratorHolder(
+        FluxSource& fluxSource, std::mutex* mutex = nullptr):
+        _fluxSource(fluxSource),
+        _mutex(mutex)
+    {
+    }
+
+    bool hasNext(unsigned physicalCylinder, unsigned head)
+    {
+        auto lock = acquire();
+        return getIterator(physicalCylinder, head).hasNext();
+    }
+
+    std::shared_ptr<const Fluxmap> next(
+        unsigned physicalCylinder, unsigned head)
+    {
+        auto lock = acquire();
+        return getIterator(physicalCylinder, head).next();
+    }
+
+    bool wasShortRead(unsigned physicalCylinder, unsigned head)
+    {
+        auto lock = acquire();
+        return getIterator(physicalCylinder, head).wasShortRead();
+    }
+
+private:
+    std::unique_lock<std::mutex> acquire()
+    {
+        if (!_mutex)
+            return std::unique_lock<std::mutex>();
+        return std::unique_lock<std::mutex>(*_mutex);
+    }
 
     FluxSourceIterator& getIterator(unsigned physicalCylinder, unsigned head)
     {
@@ -51,6 +91,7 @@ public:
 
 private:
     FluxSource& _fluxSource;
+    std::mutex* _mutex;
     std::map<std::pair<unsigned, unsigned>, std::unique_ptr<FluxSourceIterator>>
         _cache;
 };
@@ -62,6 +103,13 @@ void measureDiskRotation()
     nanoseconds_t oneRevolution =
         globalConfig()->drive().rotational_period_ms() * 1e6;
     if (oneRevolution == 0)
+    {
+        oneRevolution = findCachedRotationalPeriod();
+        if (oneRevolution != 0)
+            globalConfig().setTransient("drive.rotational_period_ms",
+                std::to_string(oneRevolution / 1e6));
+    }
+    if (oneRevolution == 0)
     {
         usbSetDrive(globalConfig()->drive().drive(),
             globalConfig()->drive().high_density(),
@@ -78,17 +126,20 @@ void measureDiskRotation()
         } while ((oneRevolution == 0) && (retries > 0));
         globalConfig().setTransient(
             "drive.rotational_period_ms", std::to_string(oneRevolution / 1e6));
+        cacheRotationalPeriod(oneRevolution);
         log(EndOperationLogMessage{});
     }
 
+    /* This is called before every track, so avoid touching the config unless
+     * something has actually changed (the drive may be busy reading on another
+     * thread). */
+
     if (!globalConfig()->drive().hard_sector_threshold_ns())
     {
         int count = globalConfig()->drive().hard_sector_count();
-        globalConfig().setTransient("drive.hard_sector_threshold_ns",
-            count ? std::to_string(
-                        oneRevolution * 3 /
-                        (4 * globalConfig()->drive().hard_sector_count()))
-                  : "0");
+        if (count)
+            globalConfig().setTransient("drive.hard_sector_threshold_ns",
+                std::to_string(oneRevolution * 3 / (4 * count)));
     }
 
     if (oneRevolution == 0)
@@ -97,8 +148,43 @@ void measureDiskRotation()
     log(EndSpeedOperationLogMessage{oneRevolution});
 }
 
-/* Given a set of sectors, deduplicates them sensibly (e.g. if there is a good
- * and bad version of the same sector, the bad version is dropped). */
+/* Combines two versions of the same sector sensibly (e.g. if there is a good
+ * and bad version, the bad version is dropped). If both are good but differ,
+ * the result is a conflict; if conflicts isn't null, a conflicting copy of
+ * right is added to it too. */
+
+static std::shared_ptr<const Sector> mergeSectors(
+    const std::shared_ptr<const Sector>& left,
+    const std::shared_ptr<const Sector>& right,
+    std::set<std::shared_ptr<const Sector>>* conflicts = nullptr)
+{
+    if ((left->status == Sector::OK) && (right->status == Sector::OK) &&
+        (left->data != right->data))
+    {
+        if (conflicts)
+        {
+            auto s = std::make_shared<Sector>(*right);
+            s->status = Sector::CONFLICT;
+            conflicts->insert(s);
+        }
+        auto s = std::make_shared<Sector>(*left);
+        s->status = Sector::CONFLICT;
+        return s;
+    }
+    if (left->status == Sector::CONFLICT)
+        return left;
+    if (right->status == Sector::CONFLICT)
+        return right;
+    if (left->status == Sector::OK)
+        return left;
+    if (right->status == Sector::OK)
+        return right;
+    if (left->status == Sector::MISSING)
+        return right;
+    return left;
+}
+
+/* Given a set of sectors, deduplicates them sensibly. */
 
 static std::set<std::shared_ptr<const Sector>> collectSectors(
     std::set<std::shared_ptr<const Sector>>& track_sectors,
@@ -124,30 +210,9 @@ static std::set<std::shared_ptr<const Sector>> collectSectors(
             it->second,
             [&](auto left, auto& rightit) -> std::shared_ptr<const Sector>
             {
-                auto& right = rightit.second;
-                if ((left->status == Sector::OK) &&
-                    (right->status == Sector::OK) &&
-                    (left->data != right->data))
-                {
-                    if (!collapse_conflicts)
-                    {
-                        auto s = std::make_shared<Sector>(*right);
-                        s->status = Sector::CONFLICT;
-                        sector_set.insert(s);
-                    }
-                    auto s = std::make_shared<Sector>(*left);
-                    s->status = Sector::CONFLICT;
-                    return s;
-                }
-                if (left->status == Sector::CONFLICT)
-                    return left;
-                if (right->status == Sector::CONFLICT)
-                    return right;
-                if (left->status == Sector::OK)
-                    return left;
-                if (right->status == Sector::OK)
-                    return right;
-                return left;
+                return mergeSectors(left,
+                    rightit.second,
+                    collapse_conflicts ? nullptr : &sector_set);
             });
         sector_set.insert(new_sector);
         it = ub;
@@ -155,39 +220,63 @@ static std::set<std::shared_ptr<const Sector>> collectSectors(
     return sector_set;
 }
 
-BadSectorsState combineRecordAndSectors(TrackFlux& trackFlux,
-    Decoder& decoder,
-    std::shared_ptr<const TrackInfo>& trackLayout)
+
+static BadSectorsState getBadSectorsState(const TrackFlux& trackFlux)
 {
-    std::set<std::shared_ptr<const Sector>> track_sectors;
+    if (trackFlux.sectors.empty() || trackFlux.badSectors)
+        return HAS_BAD_SECTORS;
+    return HAS_NO_BAD_SECTORS;
+}
 
-    /* Add the sectors which were there. */
+static void mergeSector(
+    TrackFlux& trackFlux, const std::shared_ptr<const Sector>& sector)
+{
+    auto& slot = trackFlux.sectorsByLocation[sector->LogicalLocation::key()];
+    auto merged = slot ? mergeSectors(slot, sector) : sector;
+    if (merged == slot)
+        return;
 
-    for (auto& trackdataflux : trackFlux.trackDatas)
-        track_sectors.insert(
-            trackdataflux->sectors.begin(), trackdataflux->sectors.end());
+    if (slot)
+    {
+        if (slot->status != Sector::OK)
+            trackFlux.badSectors--;
+        trackFlux.sectors.erase(slot);
+    }
+    if (merged->status != Sector::OK)
+        trackFlux.badSectors++;
+    trackFlux.sectors.insert(merged);
+    slot = merged;
+}
 
-    /* Add the sectors which should be there. */
+BadSectorsState combineRecordAndSectors(TrackFlux& trackFlux,
+    Decoder& decoder,
+    std::shared_ptr<const TrackInfo>& trackLayout)
+{
+    /* The first time through, add the sectors which should be there. */
 
-    for (unsigned sectorId : trackLayout->naturalSectorOrder)
+    if (trackFlux.sectorsByLocation.empty())
     {
-        auto sector = std::make_shared<Sector>(LogicalLocation{
-            trackLayout->logicalTrack, trackLayout->logicalSide, sectorId});
+        for (unsigned sectorId : trackLayout->naturalSectorOrder)
+        {
+            auto sector = std::make_shared<Sector>(LogicalLocation{
+                trackLayout->logicalTrack, trackLayout->logicalSide, sectorId});
 
-        sector->status = Sector::MISSING;
-        track_sectors.insert(sector);
+            sector->status = Sector::MISSING;
+            mergeSector(trackFlux, sector);
+        }
     }
 
-    /* Deduplicate. */
+    /* Add the sectors which were there, from any reads not yet seen. */
 
-    trackFlux.sectors = collectSectors(track_sectors);
-    if (trackFlux.sectors.empty())
-        return HAS_BAD_SECTORS;
-    for (const auto& sector : trackFlux.sectors)
-        if (sector->status != Sector::OK)
-            return HAS_BAD_SECTORS;
+    for (; trackFlux.mergedTrackDatas < trackFlux.trackDatas.size();
+         trackFlux.mergedTrackDatas++)
+    {
+        for (const auto& sector :
+            trackFlux.trackDatas[trackFlux.mergedTrackDatas]->sectors)
+            mergeSector(trackFlux, sector);
+    }
 
-    return HAS_NO_BAD_SECTORS;
+    return getBadSectorsState(trackFlux);
 }
 
 static void adjustTrackOnError(FluxSource& fluxSource, int baseTrack)
@@ -210,6 +299,36 @@ static void adjustTrackOnError(FluxSource& fluxSource, int baseTrack)
     }
 }
 
+/* Puts the tracks into the order in which the drive should visit them. The
+ * layout produces them a cylinder at a time, which is the default. */
+
+static std::vector<std::shared_ptr<const TrackInfo>> scheduleLocations(
+    const std::vector<std::shared_ptr<const TrackInfo>>& locations)
+{
+    auto order = globalConfig()->drive().track_order();
+    if (order == DriveProto::CYLINDERS)
+        return locations;
+
+    std::map<unsigned, std::vector<std::shared_ptr<const TrackInfo>>> sides;
+    for (const auto& trackInfo : locations)
+        sides[trackInfo->physicalSide].push_back(trackInfo);
+
+    std::vector<std::shared_ptr<const TrackInfo>> scheduled;
+    bool reversed = false;
+    for (auto& it : sides)
+    {
+        auto& tracks = it.second;
+        if (reversed)
+            scheduled.insert(scheduled.end(), tracks.rbegin(), tracks.rend());
+        else
+            scheduled.insert(scheduled.end(), tracks.begin(), tracks.end());
+
+        if (order == DriveProto::SERPENTINE)
+            reversed = !reversed;
+    }
+    return scheduled;
+}
+
 ReadResult readGroup(FluxSourceIteratorHolder& fluxSourceIteratorHolder,
     std::shared_ptr<const TrackInfo>& trackInfo,
     TrackFlux& trackFlux,
@@ -220,37 +339,116 @@ ReadResult readGroup(FluxSourceIteratorHolder& fluxSourceIteratorHolder,
     for (unsigned offset = 0; offset < trackInfo->groupSize;
          offset += Layout::getHeadWidth())
     {
-        auto& fluxSourceIterator = fluxSourceIteratorHolder.getIterator(
-            trackInfo->physicalTrack + offset, trackInfo->physicalSide);
-        if (!fluxSourceIterator.hasNext())
+        unsigned physicalTrack = trackInfo->physicalTrack + offset;
+        unsigned physicalSide = trackInfo->physicalSide;
+        if (!fluxSourceIteratorHolder.hasNext(physicalTrack, physicalSide))
             continue;
 
-        log(BeginReadOperationLogMessage{
-            trackInfo->physicalTrack + offset, trackInfo->physicalSide});
-        std::shared_ptr<const Fluxmap> fluxmap = fluxSourceIterator.next();
-        // ->rescale(
-        //     1.0 / globalConfig()->flux_source().rescale());
-        log(EndReadOperationLogMessage());
-        log("{0} ms in {1} bytes",
-            (int)(fluxmap->duration() / 1e6),
-            fluxmap->bytes());
+        BadSectorsState state;
+        for (;;)
+        {
+            log(BeginReadOperationLogMessage{physicalTrack, physicalSide});
+            std::shared_ptr<const Fluxmap> fluxmap =
+                fluxSourceIteratorHolder.next(physicalTrack, physicalSide);
+            // ->rescale(
+            //     1.0 / globalConfig()->flux_source().rescale());
+            log(EndReadOperationLogMessage());
+            log("{0} ms in {1} bytes",
+                (int)(fluxmap->duration() / 1e6),
+                fluxmap->bytes());
+
+            auto trackdataflux = decoder.decodeToSectors(fluxmap, trackInfo);
+            trackFlux.trackDatas.push_back(trackdataflux);
+            state = combineRecordAndSectors(trackFlux, decoder, trackInfo);
+
+            /* If a deliberately short read didn't get everything, follow it
+             * up with a full one straight away; this doesn't count as a
+             * retry. */
+
+            if ((state == HAS_NO_BAD_SECTORS) ||
+                !fluxSourceIteratorHolder.wasShortRead(
+                    physicalTrack, physicalSide))
+                break;
+            log("short read incomplete; reading again");
+        }
 
-        auto trackdataflux = decoder.decodeToSectors(fluxmap, trackInfo);
-        trackFlux.trackDatas.push_back(trackdataflux);
-        if (combineRecordAndSectors(trackFlux, decoder, trackInfo) ==
-            HAS_NO_BAD_SECTORS)
+        if (state == HAS_NO_BAD_SECTORS)
         {
             result = GOOD_READ;
             if (globalConfig()->decoder().skip_unnecessary_tracks())
                 return result;
         }
-        else if (fluxSourceIterator.hasNext())
+        else if (fluxSourceIteratorHolder.hasNext(physicalTrack, physicalSide))
             result = BAD_AND_CAN_RETRY;
     }
 
     return result;
 }
 
+typedef std::function<std::unique_ptr<const Fluxmap>(
+    std::shared_ptr<const TrackInfo>& trackInfo)>
+    TrackProducer;
+typedef std::function<bool(std::shared_ptr<const TrackInfo>& trackInfo)>
+    TrackVerifier;
+
+static void writeTrack(FluxSink& fluxSink,
+    const TrackProducer& producer,
+    std::shared_ptr<const TrackInfo>& trackInfo)
+{
+    for (int offset = 0; offset < trackInfo->groupSize;
+         offset += Layout::getHeadWidth())
+    {
+        unsigned physicalTrack = trackInfo->physicalTrack + offset;
+
+        log(BeginWriteOperationLogMessage{
+            physicalTrack, trackInfo->physicalSide});
+
+        if (offset == globalConfig()->drive().group_offset())
+        {
+            auto fluxmap = producer(trackInfo);
+            if (!fluxmap)
+                goto erase;
+
+            fluxSink.writeFlux(
+                physicalTrack, trackInfo->physicalSide, *fluxmap);
+            log("writing {0} ms in {1} bytes",
+                int(fluxmap->duration() / 1e6),
+                fluxmap->bytes());
+        }
+        else
+        {
+        erase:
+            /* Erase this track rather than writing. */
+
+            Fluxmap blank;
+            fluxSink.writeFlux(physicalTrack, trackInfo->physicalSide, blank);
+            log("erased");
+        }
+
+        log(EndWriteOperationLogMessage());
+    }
+}
+
+static void writeAndVerifyTrack(FluxSink& fluxSink,
+    const TrackProducer& producer,
+    const TrackVerifier& verifier,
+    std::shared_ptr<const TrackInfo>& trackInfo)
+{
+    int retriesRemaining = globalConfig()->decoder().retries();
+    for (;;)
+    {
+        writeTrack(fluxSink, producer, trackInfo);
+        if (verifier(trackInfo))
+            break;
+
+        if (retriesRemaining == 0)
+            error("fatal error on write");
+
+        log("retrying; {} retries remaining", retriesRemaining);
+        retriesRemaining--;
+    }
+}
+
 void writeTracks(FluxSink& fluxSink,
     std::function<std::unique_ptr<const Fluxmap>(
         std::shared_ptr<const TrackInfo>& trackInfo)> producer,
@@ -261,77 +459,148 @@ void writeTracks(FluxSink& fluxSink,
 
     if (fluxSink.isHardware())
         measureDiskRotation();
+    auto scheduled = scheduleLocations(trackInfos);
     int index = 0;
-    for (auto& trackInfo : trackInfos)
+    for (auto& trackInfo : scheduled)
     {
         log(OperationProgressLogMessage{
             index * 100 / (unsigned)trackInfos.size()});
         index++;
 
         testForEmergencyStop();
+        writeAndVerifyTrack(fluxSink, producer, verifier, trackInfo);
+    }
 
-        int retriesRemaining = globalConfig()->decoder().retries();
-        for (;;)
+    log(EndOperationLogMessage{"Write complete"});
+}
+
+/* Encodes tracks on a pool of worker threads, running ahead of the drive so
+ * that the writer doesn't have to wait for each track to be encoded. Each
+ * worker slot has its own encoder. Tracks must be asked for in the order in
+ * which they were given; anything else (such as a track being written again
+ * after a failed verify) is encoded on the calling thread instead. */
+
+class TrackEncoderPool
+{
+public:
+    TrackEncoderPool(Encoder& encoder,
+        const Image& image,
+        const std::vector<std::shared_ptr<const TrackInfo>>& locations):
+        _encoder(encoder),
+        _image(image),
+        _locations(locations)
+    {
+        unsigned threads = globalConfig()->encoder().threads();
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        threads = std::min<unsigned>(threads, locations.size());
+
+        /* Even with only one CPU, encoding can happen while the drive is
+         * busy, so a single worker is still worth having unless the user has
+         * explicitly asked for none. */
+
+        if (globalConfig()->encoder().threads() != 1)
         {
-            for (int offset = 0; offset < trackInfo->groupSize;
-                 offset += Layout::getHeadWidth())
+            threads = std::max(1U, threads);
+            for (unsigned i = 0; i < threads; i++)
+                _encoders.push_back(Encoder::create(globalConfig()->encoder()));
+        }
+    }
+
+    ~TrackEncoderPool()
+    {
+        for (auto& f : _pending)
+        {
+            try
+            {
+                f.wait();
+            }
+            catch (...)
             {
-                unsigned physicalTrack = trackInfo->physicalTrack + offset;
+            }
+        }
+    }
 
-                log(BeginWriteOperationLogMessage{
-                    physicalTrack, trackInfo->physicalSide});
+    std::unique_ptr<const Fluxmap> encode(
+        std::shared_ptr<const TrackInfo>& trackInfo)
+    {
+        if (!_encoders.empty())
+        {
+            auto it = std::find(
+                _locations.begin() + _consumed, _locations.end(), trackInfo);
+            if (it != _locations.end())
+            {
+                /* Discard any tracks which were skipped over. */
 
-                if (offset == globalConfig()->drive().group_offset())
+                unsigned index = it - _locations.begin();
+                for (;;)
                 {
-                    auto fluxmap = producer(trackInfo);
-                    if (!fluxmap)
-                        goto erase;
-
-                    fluxSink.writeFlux(
-                        physicalTrack, trackInfo->physicalSide, *fluxmap);
-                    log("writing {0} ms in {1} bytes",
-                        int(fluxmap->duration() / 1e6),
-                        fluxmap->bytes());
-                }
-                else
-                {
-                erase:
-                    /* Erase this track rather than writing. */
-
-                    Fluxmap blank;
-                    fluxSink.writeFlux(
-                        physicalTrack, trackInfo->physicalSide, blank);
-                    log("erased");
+                    fill();
+                    auto result = _pending.front().get();
+                    _pending.pop_front();
+                    if (_consumed++ == index)
+                    {
+                        for (const auto& message : result.messages)
+                            log(message);
+                        fill();
+                        return std::move(result.fluxmap);
+                    }
                 }
-
-                log(EndWriteOperationLogMessage());
             }
+        }
 
-            if (verifier(trackInfo))
-                break;
+        auto sectors = _encoder.collectSectors(trackInfo, _image);
+        return _encoder.encode(trackInfo, sectors, _image);
+    }
 
-            if (retriesRemaining == 0)
-                error("fatal error on write");
+private:
+    struct EncodedTrack
+    {
+        std::unique_ptr<const Fluxmap> fluxmap;
+        std::vector<std::shared_ptr<const AnyLogMessage>> messages;
+    };
 
-            log("retrying; {} retries remaining", retriesRemaining);
-            retriesRemaining--;
+    void fill()
+    {
+        while ((_queued < _locations.size()) &&
+               (_queued < (_consumed + _encoders.size())))
+        {
+            unsigned slot = _queued % _encoders.size();
+            auto& trackInfo = _locations[_queued++];
+            _pending.push_back(std::async(std::launch::async,
+                [this, slot, &trackInfo]
+                {
+                    EncodedTrack result;
+                    Logger::Capture capture(result.messages);
+                    auto& encoder = *_encoders[slot];
+                    auto sectors = encoder.collectSectors(trackInfo, _image);
+                    result.fluxmap = encoder.encode(trackInfo, sectors, _image);
+                    return result;
+                }));
         }
     }
 
-    log(EndOperationLogMessage{"Write complete"});
-}
+private:
+    Encoder& _encoder;
+    const Image& _image;
+    std::vector<std::shared_ptr<const TrackInfo>> _locations;
+    std::vector<std::unique_ptr<Encoder>> _encoders;
+    std::deque<std::future<EncodedTrack>> _pending;
+    unsigned _queued = 0;
+    unsigned _consumed = 0;
+};
 
 void writeTracks(FluxSink& fluxSink,
     Encoder& encoder,
     const Image& image,
     std::vector<std::shared_ptr<const TrackInfo>>& trackInfos)
 {
+    TrackEncoderPool pool(encoder, image, scheduleLocations(trackInfos));
     writeTracks(
         fluxSink,
         [&](std::shared_ptr<const TrackInfo>& trackInfo)
         {
-            auto sectors = encoder.collectSectors(trackInfo, image);
-            return encoder.encode(trackInfo, sectors, image);
+            return pool.encode(trackInfo);
         },
         [](const auto&)
         {
@@ -340,6 +609,136 @@ void writeTracks(FluxSink& fluxSink,
         trackInfos);
 }
 
+/* Returns the sectors which the encoder should have written to a track. */
+
+static Image getWantedSectors(Encoder& encoder,
+    std::shared_ptr<const TrackInfo>& trackInfo,
+    const Image& image)
+{
+    Image wanted;
+    for (const auto& sector : encoder.collectSectors(trackInfo, image))
+        wanted
+            .put(sector->logicalTrack,
+                sector->logicalSide,
+                sector->logicalSector)
+            ->data = sector->data;
+    return wanted;
+}
+
+static bool compareWithWantedSectors(const TrackFlux& trackFlux, Image& wanted)
+{
+    for (const auto& sector : trackFlux.sectors)
+    {
+        const auto s = wanted.get(
+            sector->logicalTrack, sector->logicalSide, sector->logicalSector);
+        if (!s)
+        {
+            log("spurious sector on verify");
+            return false;
+        }
+        if (s->data != sector->data.slice(0, s->data.size()))
+        {
+            log("data mismatch on verify");
+            return false;
+        }
+        wanted.erase(
+            sector->logicalTrack, sector->logicalSide, sector->logicalSector);
+    }
+    if (!wanted.empty())
+    {
+        log("missing sector on verify");
+        return false;
+    }
+    return true;
+}
+
+/* Verifies tracks in the background. The flux is read back by the caller, so
+ * that the drive is only ever used from one thread, but decoding it and
+ * comparing it with what should be there happens on a worker while the next
+ * track is being written. Tracks which fail are collected for the caller to
+ * deal with at the end. */
+
+class TrackVerifierPool
+{
+public:
+    TrackVerifierPool(Decoder& decoder): _decoder(decoder) {}
+
+    ~TrackVerifierPool()
+    {
+        if (_pending.valid())
+            _pending.wait();
+    }
+
+    void verify(std::shared_ptr<const TrackInfo>& trackInfo,
+        std::vector<std::shared_ptr<const Fluxmap>> fluxmaps,
+        Image wanted)
+    {
+        collect();
+        _pending = std::async(std::launch::async,
+            [this,
+                trackInfo,
+                fluxmaps = std::move(fluxmaps),
+                wanted = std::move(wanted)]() mutable
+            {
+                VerifiedTrack result;
+                result.trackInfo = trackInfo;
+                Logger::Capture capture(result.messages);
+
+                auto trackFlux = std::make_shared<TrackFlux>();
+                trackFlux->trackInfo = trackInfo;
+                BadSectorsState state = HAS_BAD_SECTORS;
+                for (const auto& fluxmap : fluxmaps)
+                {
+                    trackFlux->trackDatas.push_back(
+                        _decoder.decodeToSectors(fluxmap, trackInfo));
+                    state =
+                        combineRecordAndSectors(*trackFlux, _decoder, trackInfo);
+                }
+                log(TrackReadLogMessage{trackFlux});
+
+                if (state != HAS_NO_BAD_SECTORS)
+                    log("bad read");
+                else
+                    result.good = compareWithWantedSectors(*trackFlux, wanted);
+                return result;
+            });
+    }
+
+    /* Waits for any outstanding verification and returns all the tracks which
+     * have failed so far. */
+
+    std::vector<std::shared_ptr<const TrackInfo>>& failures()
+    {
+        collect();
+        return _failures;
+    }
+
+private:
+    struct VerifiedTrack
+    {
+        std::shared_ptr<const TrackInfo> trackInfo;
+        bool good = false;
+        std::vector<std::shared_ptr<const AnyLogMessage>> messages;
+    };
+
+    void collect()
+    {
+        if (!_pending.valid())
+            return;
+
+        auto result = _pending.get();
+        for (const auto& message : result.messages)
+            log(message);
+        if (!result.good)
+            _failures.push_back(result.trackInfo);
+    }
+
+private:
+    Decoder& _decoder;
+    std::future<VerifiedTrack> _pending;
+    std::vector<std::shared_ptr<const TrackInfo>> _failures;
+};
+
 void writeTracksAndVerify(FluxSink& fluxSink,
     Encoder& encoder,
     FluxSource& fluxSource,
@@ -347,64 +746,90 @@ void writeTracksAndVerify(FluxSink& fluxSink,
     const Image& image,
     std::vector<std::shared_ptr<const TrackInfo>>& trackInfos)
 {
-    writeTracks(
-        fluxSink,
-        [&](std::shared_ptr<const TrackInfo>& trackInfo)
+    log(BeginOperationLogMessage{"Encoding and writing to disk"});
+
+    if (fluxSink.isHardware())
+        measureDiskRotation();
+    auto scheduled = scheduleLocations(trackInfos);
+    TrackEncoderPool encoderPool(encoder, image, scheduled);
+    TrackProducer producer = [&](std::shared_ptr<const TrackInfo>& trackInfo)
+    {
+        return encoderPool.encode(trackInfo);
+    };
+    TrackVerifier verifier = [&](std::shared_ptr<const TrackInfo>& trackInfo)
+    {
+        auto trackFlux = std::make_shared<TrackFlux>();
+        trackFlux->trackInfo = trackInfo;
+        FluxSourceIteratorHolder fluxSourceIteratorHolder(fluxSource);
+        auto result = readGroup(
+            fluxSourceIteratorHolder, trackInfo, *trackFlux, decoder);
+        log(TrackReadLogMessage{trackFlux});
+
+        if (result != GOOD_READ)
         {
-            auto sectors = encoder.collectSectors(trackInfo, image);
-            return encoder.encode(trackInfo, sectors, image);
-        },
-        [&](std::shared_ptr<const TrackInfo>& trackInfo)
+            adjustTrackOnError(fluxSource, trackInfo->physicalTrack);
+            log("bad read");
+            return false;
+        }
+
+        Image wanted = getWantedSectors(encoder, trackInfo, image);
+        return compareWithWantedSectors(*trackFlux, wanted);
+    };
+
+    TrackVerifierPool verifierPool(decoder);
+    int index = 0;
+    for (auto& trackInfo : scheduled)
+    {
+        log(OperationProgressLogMessage{
+            index * 100 / (unsigned)trackInfos.size()});
+        index++;
+
+        testForEmergencyStop();
+        writeTrack(fluxSink, producer, trackInfo);
+
+        std::vector<std::shared_ptr<const Fluxmap>> fluxmaps;
+        FluxSourceIteratorHolder fluxSourceIteratorHolder(fluxSource);
+        for (unsigned offset = 0; offset < trackInfo->groupSize;
+             offset += Layout::getHeadWidth())
         {
-            auto trackFlux = std::make_shared<TrackFlux>();
-            trackFlux->trackInfo = trackInfo;
-            FluxSourceIteratorHolder fluxSourceIteratorHolder(fluxSource);
-            auto result = readGroup(
-                fluxSourceIteratorHolder, trackInfo, *trackFlux, decoder);
-            log(TrackReadLogMessage{trackFlux});
+            unsigned physicalTrack = trackInfo->physicalTrack + offset;
+            unsigned physicalSide = trackInfo->physicalSide;
+            if (!fluxSourceIteratorHolder.hasNext(physicalTrack, physicalSide))
+                continue;
+
+            log(BeginReadOperationLogMessage{physicalTrack, physicalSide});
+            fluxmaps.push_back(
+                fluxSourceIteratorHolder.next(physicalTrack, physicalSide));
+            log(EndReadOperationLogMessage());
+            log("{0} ms in {1} bytes",
+                (int)(fluxmaps.back()->duration() / 1e6),
+                fluxmaps.back()->bytes());
+        }
 
-            if (result != GOOD_READ)
-            {
-                adjustTrackOnError(fluxSource, trackInfo->physicalTrack);
-                log("bad read");
-                return false;
-            }
+        verifierPool.verify(trackInfo,
+            std::move(fluxmaps),
+            getWantedSectors(encoder, trackInfo, image));
+    }
 
-            Image wanted;
-            for (const auto& sector : encoder.collectSectors(trackInfo, image))
-                wanted
-                    .put(sector->logicalTrack,
-                        sector->logicalSide,
-                        sector->logicalSector)
-                    ->data = sector->data;
+    /* Go back to anything which failed. The first read back may just have
+     * been unlucky (or deliberately short), so check it again before
+     * rewriting it. */
 
-            for (const auto& sector : trackFlux->sectors)
-            {
-                const auto s = wanted.get(sector->logicalTrack,
-                    sector->logicalSide,
-                    sector->logicalSector);
-                if (!s)
-                {
-                    log("spurious sector on verify");
-                    return false;
-                }
-                if (s->data != sector->data.slice(0, s->data.size()))
-                {
-                    log("data mismatch on verify");
-                    return false;
-                }
-                wanted.erase(sector->logicalTrack,
-                    sector->logicalSide,
-                    sector->logicalSector);
-            }
-            if (!wanted.empty())
-            {
-                log("missing sector on verify");
-                return false;
-            }
-            return true;
-        },
-        trackInfos);
+    for (auto& trackInfo : verifierPool.failures())
+    {
+        testForEmergencyStop();
+
+        log("verifying track {}.{} again",
+            trackInfo->physicalTrack,
+            trackInfo->physicalSide);
+        if (!verifier(trackInfo))
+        {
+            log("rewriting");
+            writeAndVerifyTrack(fluxSink, producer, verifier, trackInfo);
+        }
+    }
+
+    log(EndOperationLogMessage{"Write complete"});
 }
 
 void writeDiskCommand(const Image& image,
@@ -449,22 +874,25 @@ void writeRawDiskCommand(FluxSource& fluxSource, FluxSink& fluxSink)
         locations);
 }
 
-std::shared_ptr<TrackFlux> readAndDecodeTrack(FluxSource& fluxSource,
+/* Reads the track into trackFlux, adding to whatever's already there. If
+ * retries are being deferred, the caller is expected to come back to the track
+ * later if it's still bad. */
+
+static void readAndDecodeTrack(
+    FluxSourceIteratorHolder& fluxSourceIteratorHolder,
+    FluxSource& fluxSource,
     Decoder& decoder,
-    std::shared_ptr<const TrackInfo>& trackInfo)
+    TrackFlux& trackFlux,
+    int retriesRemaining,
+    bool deferRetries)
 {
-    auto trackFlux = std::make_shared<TrackFlux>();
-    trackFlux->trackInfo = trackInfo;
-
     if (fluxSource.isHardware())
         measureDiskRotation();
 
-    FluxSourceIteratorHolder fluxSourceIteratorHolder(fluxSource);
-    int retriesRemaining = globalConfig()->decoder().retries();
     for (;;)
     {
-        auto result =
-            readGroup(fluxSourceIteratorHolder, trackInfo, *trackFlux, decoder);
+        auto result = readGroup(
+            fluxSourceIteratorHolder, trackFlux.trackInfo, trackFlux, decoder);
         if (result == GOOD_READ)
             break;
         if (result == BAD_AND_CAN_NOT_RETRY)
@@ -475,111 +903,548 @@ std::shared_ptr<TrackFlux> readAndDecodeTrack(FluxSource& fluxSource,
 
         if (retriesRemaining == 0)
         {
-            log("giving up");
+            log(deferRetries ? "leaving retries until the end" : "giving up");
             break;
         }
 
         if (fluxSource.isHardware())
         {
-            adjustTrackOnError(fluxSource, trackInfo->physicalTrack);
+            adjustTrackOnError(
+                fluxSource, trackFlux.trackInfo->physicalTrack);
             log("retrying; {} retries remaining", retriesRemaining);
             retriesRemaining--;
         }
     }
+}
 
+std::shared_ptr<TrackFlux> readAndDecodeTrack(FluxSource& fluxSource,
+    Decoder& decoder,
+    std::shared_ptr<const TrackInfo>& trackInfo)
+{
+    auto trackFlux = std::make_shared<TrackFlux>();
+    trackFlux->trackInfo = trackInfo;
+
+    FluxSourceIteratorHolder fluxSourceIteratorHolder(fluxSource);
+    readAndDecodeTrack(fluxSourceIteratorHolder,
+        fluxSource,
+        decoder,
+        *trackFlux,
+        globalConfig()->decoder().retries(),
+        false);
     return trackFlux;
 }
 
-std::shared_ptr<const DiskFlux> readDiskCommand(
-    FluxSource& fluxSource, Decoder& decoder)
+/* Talks to a hardware flux source on a thread of its own, so that the drive can
+ * be reading the next track while the current one is being decoded. Every
+ * operation on the underlying source goes through that thread, in the order
+ * in which it was asked for. Once prefetch() has been called, the next read
+ * also queues up a read of the given track; the first read of that track then
+ * takes the result rather than going back to the drive. Anything logged by the
+ * read is replayed on the calling thread when the result is picked up. */
+
+class PipelinedFluxSource : public FluxSource
 {
-    std::unique_ptr<FluxSink> outputFluxSink;
-    if (globalConfig()->decoder().has_copy_flux_to())
-        outputFluxSink =
-            FluxSink::create(globalConfig()->decoder().copy_flux_to());
+private:
+    struct CapturedFlux
+    {
+        std::unique_ptr<const Fluxmap> fluxmap;
+        bool shortRead;
+        std::vector<std::shared_ptr<const AnyLogMessage>> messages;
+    };
 
-    auto diskflux = std::make_shared<DiskFlux>();
+    struct PrefetchedFlux
+    {
+        std::shared_ptr<FluxSourceIterator> iterator;
+        std::future<CapturedFlux> capturedFlux;
+    };
 
-    log(BeginOperationLogMessage{"Reading and decoding disk"});
-    auto locations = Layout::computeLocations();
-    unsigned index = 0;
-    for (auto& trackInfo : locations)
+    class PipelinedFluxSourceIterator : public FluxSourceIterator
     {
-        log(OperationProgressLogMessage{
-            index * 100 / (unsigned)locations.size()});
-        index++;
+    public:
+        PipelinedFluxSourceIterator(
+            PipelinedFluxSource& source, int track, int side):
+            _source(source),
+            _track(track),
+            _side(side)
+        {
+        }
 
-        testForEmergencyStop();
+        bool hasNext() const override
+        {
+            return true;
+        }
 
-        auto trackFlux = readAndDecodeTrack(fluxSource, decoder, trackInfo);
-        diskflux->tracks.push_back(trackFlux);
+        std::unique_ptr<const Fluxmap> next() override
+        {
+            auto capturedFlux = _source.read(_track, _side, _iterator);
+            _shortRead = capturedFlux.shortRead;
+            return std::move(capturedFlux.fluxmap);
+        }
 
-        if (outputFluxSink)
+        bool wasShortRead() const override
         {
-            for (const auto& data : trackFlux->trackDatas)
-                outputFluxSink->writeFlux(trackInfo->physicalTrack,
-                    trackInfo->physicalSide,
-                    *data->fluxmap);
+            return _shortRead;
         }
 
-        if (globalConfig()->decoder().dump_records())
+    private:
+        PipelinedFluxSource& _source;
+        int _track;
+        int _side;
+        std::shared_ptr<FluxSourceIterator> _iterator;
+        bool _shortRead = false;
+    };
+
+public:
+    PipelinedFluxSource(FluxSource& fluxSource):
+        _fluxSource(fluxSource),
+        _thread(&PipelinedFluxSource::run, this)
+    {
+    }
+
+    ~PipelinedFluxSource()
+    {
+        /* Anything still queued is abandoned, but an operation which is
+         * already in progress has to be allowed to finish. */
+
         {
-            std::vector<std::shared_ptr<const Record>> sorted_records;
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _condition.notify_one();
+        _thread.join();
+    }
+
+public:
+    std::unique_ptr<FluxSourceIterator> readFlux(int track, int side) override
+    {
+        return std::make_unique<PipelinedFluxSourceIterator>(
+            *this, track, side);
+    }
+
+    void recalibrate() override
+    {
+        submit<void>(
+            [&]
+            {
+                _fluxSource.recalibrate();
+            })
+            .get();
+    }
 
-            for (const auto& data : trackFlux->trackDatas)
-                sorted_records.insert(sorted_records.end(),
-                    data->records.begin(),
-                    data->records.end());
+    void seek(int track) override
+    {
+        submit<void>(
+            [&]
+            {
+                _fluxSource.seek(track);
+            })
+            .get();
+    }
 
-            std::sort(sorted_records.begin(),
-                sorted_records.end(),
-                [](const auto& o1, const auto& o2)
+    bool isHardware() override
+    {
+        return true;
+    }
+
+    void prefetch(int track, int side)
+    {
+        _prefetch = std::make_pair(track, side);
+    }
+
+private:
+    /* The underlying iterator is kept by the caller's iterator (or with the
+     * prefetched flux until it's claimed), as it may need to know about
+     * previous reads of the same track. */
+
+    CapturedFlux read(
+        int track, int side, std::shared_ptr<FluxSourceIterator>& iterator)
+    {
+        std::future<CapturedFlux> result;
+        auto it = _prefetched.find(std::make_pair(track, side));
+        if (!iterator && (it != _prefetched.end()))
+        {
+            iterator = it->second.iterator;
+            result = std::move(it->second.capturedFlux);
+            _prefetched.erase(it);
+        }
+        else
+        {
+            if (!iterator)
+                iterator = _fluxSource.readFlux(track, side);
+            result = capture(iterator);
+        }
+
+        if (_prefetch)
+        {
+            if (!_prefetched.count(*_prefetch))
+            {
+                auto& prefetched = _prefetched[*_prefetch];
+                prefetched.iterator =
+                    _fluxSource.readFlux(_prefetch->first, _prefetch->second);
+                prefetched.capturedFlux = capture(prefetched.iterator);
+            }
+            _prefetch.reset();
+        }
+
+        auto capturedFlux = result.get();
+        for (const auto& message : capturedFlux.messages)
+            log(message);
+        return capturedFlux;
+    }
+
+    std::future<CapturedFlux> capture(
+        std::shared_ptr<FluxSourceIterator> iterator)
+    {
+        return submit<CapturedFlux>(
+            [iterator]
+            {
+                CapturedFlux capturedFlux;
+                Logger::Capture capture(capturedFlux.messages);
+                capturedFlux.fluxmap = iterator->next();
+                capturedFlux.shortRead = iterator->wasShortRead();
+                return capturedFlux;
+            });
+    }
+
+    template <class T>
+    std::future<T> submit(std::function<T()> operation)
+    {
+        auto task = std::make_shared<std::packaged_task<T()>>(operation);
+        auto future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue.push_back(
+                [task]
                 {
-                    return o1->startTime < o2->startTime;
+                    (*task)();
                 });
+        }
+        _condition.notify_one();
+        return future;
+    }
 
-            std::cout << "\nRaw (undecoded) records follow:\n\n";
-            for (const auto& record : sorted_records)
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> operation;
             {
-                std::cout << fmt::format("I+{:.2f}us with {:.2f}us clock\n",
-                    record->startTime / 1000.0,
-                    record->clock / 1000.0);
-                hexdump(std::cout, record->rawData);
-                std::cout << std::endl;
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock,
+                    [&]
+                    {
+                        return _stopping || !_queue.empty();
+                    });
+                if (_stopping)
+                    return;
+                operation = std::move(_queue.front());
+                _queue.pop_front();
             }
+            operation();
+        }
+    }
+
+private:
+    FluxSource& _fluxSource;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<std::function<void()>> _queue;
+    bool _stopping = false;
+    std::optional<std::pair<int, int>> _prefetch;
+    std::map<std::pair<int, int>, PrefetchedFlux> _prefetched;
+    std::thread _thread;
+};
+
+/* Decodes tracks from a flux file on a pool of worker threads. Each worker
+ * slot has its own decoder; the tracks are handed back strictly in the order
+ * they were requested, along with any log messages generated while decoding
+ * them, so that the caller sees exactly what it would have seen had they been
+ * decoded serially. Hardware sources can't be read in parallel and so are
+ * always decoded on the calling thread; but if drive.read_ahead is set, the
+ * drive is left reading the next track while that happens.
+ * Hardware reads may also leave their retries for the caller to do with
+ * retry() once everything else has been read. */
+
+class TrackDecoderPool
+{
+public:
+    TrackDecoderPool(FluxSource& fluxSource,
+        Decoder& decoder,
+        std::vector<std::shared_ptr<const TrackInfo>>& locations):
+        _fluxSource(fluxSource),
+        _decoder(decoder),
+        _locations(locations)
+    {
+        unsigned threads = globalConfig()->decoder().threads();
+        if (threads == 0)
+            threads = std::thread::hardware_concurrency();
+        if (fluxSource.isHardware())
+        {
+            /* The drive does its work without needing a CPU, so this is worth
+             * doing even on a single-core machine. */
+
+            if (globalConfig()->drive().read_ahead())
+                _pipeline = std::make_unique<PipelinedFluxSource>(fluxSource);
+            threads = 1;
+
+            _deferRetries = globalConfig()->drive().defer_retries() &&
+                            (globalConfig()->decoder().retries() > 0);
+        }
+        threads = std::max(1U, std::min<unsigned>(threads, locations.size()));
+
+        if (threads > 1)
+        {
+            for (unsigned i = 0; i < threads; i++)
+                _decoders.push_back(Decoder::create(globalConfig()->decoder()));
+        }
+    }
+
+    ~TrackDecoderPool()
+    {
+        /* Don't leave workers running if we're being unwound. */
+
+        drain();
+    }
+
+    bool defersRetries() const
+    {
+        return _deferRetries;
+    }
+
+    /* Returns the decoded track at the next location. When decoding serially,
+     * messages are logged as they happen; otherwise they're returned in
+     * messages for the caller to log. */
+
+    std::shared_ptr<TrackFlux> next(
+        std::vector<std::shared_ptr<const AnyLogMessage>>& messages)
+    {
+        unsigned index = _consumed++;
+        if (_pipeline && ((index + 1) < _locations.size()))
+            _pipeline->prefetch(_locations[index + 1]->physicalTrack,
+                _locations[index + 1]->physicalSide);
+        if (_decoders.empty())
+        {
+            auto trackFlux = std::make_shared<TrackFlux>();
+            trackFlux->trackInfo = _locations[index];
+
+            FluxSourceIteratorHolder fluxSourceIteratorHolder(source());
+            readAndDecodeTrack(fluxSourceIteratorHolder,
+                source(),
+                _decoder,
+                *trackFlux,
+                _deferRetries ? 0 : globalConfig()->decoder().retries(),
+                _deferRetries);
+            return trackFlux;
         }
 
-        if (globalConfig()->decoder().dump_sectors())
+        while ((_queued < _locations.size()) &&
+               (_queued < (index + _decoders.size())))
         {
-            auto collected_sectors = collectSectors(trackFlux->sectors, false);
-            std::vector<std::shared_ptr<const Sector>> sorted_sectors(
-                collected_sectors.begin(), collected_sectors.end());
-            std::sort(sorted_sectors.begin(),
-                sorted_sectors.end(),
-                [](const auto& o1, const auto& o2)
+            unsigned slot = _queued % _decoders.size();
+            auto& trackInfo = _locations[_queued++];
+            _pending.push_back(std::async(std::launch::async,
+                [this, slot, &trackInfo]
                 {
-                    return *o1 < *o2;
-                });
+                    DecodedTrack result;
+                    Logger::Capture capture(result.messages);
+                    result.trackFlux = std::make_shared<TrackFlux>();
+                    result.trackFlux->trackInfo = trackInfo;
+
+                    FluxSourceIteratorHolder fluxSourceIteratorHolder(
+                        _fluxSource, &_fluxSourceMutex);
+                    readAndDecodeTrack(fluxSourceIteratorHolder,
+                        _fluxSource,
+                        *_decoders[slot],
+                        *result.trackFlux,
+                        globalConfig()->decoder().retries(),
+                        false);
+                    return result;
+                }));
+        }
+
+        auto result = _pending.front().get();
+        _pending.pop_front();
+        messages = std::move(result.messages);
+        return result.trackFlux;
+    }
+
+    /* Goes back to a track which next() left bad. The read which brings the
+     * head back counts as the first retry. */
+
+    void retry(TrackFlux& trackFlux)
+    {
+        log("retrying deferred track");
+        FluxSourceIteratorHolder fluxSourceIteratorHolder(source());
+        readAndDecodeTrack(fluxSourceIteratorHolder,
+            source(),
+            _decoder,
+            trackFlux,
+            globalConfig()->decoder().retries() - 1,
+            false);
+    }
 
-            std::cout << "\nDecoded sectors follow:\n\n";
-            for (const auto& sector : sorted_sectors)
+private:
+    FluxSource& source()
+    {
+        if (_pipeline)
+            return *_pipeline;
+        return _fluxSource;
+    }
+
+    void drain()
+    {
+        for (auto& f : _pending)
+        {
+            try
+            {
+                f.wait();
+            }
+            catch (...)
             {
-                std::cout << fmt::format(
-                    "{}.{:02}.{:02}: I+{:.2f}us with {:.2f}us clock: "
-                    "status {}\n",
-                    sector->logicalTrack,
-                    sector->logicalSide,
-                    sector->logicalSector,
-                    sector->headerStartTime / 1000.0,
-                    sector->clock / 1000.0,
-                    Sector::statusToString(sector->status));
-                hexdump(std::cout, sector->data);
-                std::cout << std::endl;
             }
         }
+        _pending.clear();
+    }
 
-        /* track can't be modified below this point. */
-        log(TrackReadLogMessage{trackFlux});
+private:
+    struct DecodedTrack
+    {
+        std::shared_ptr<TrackFlux> trackFlux;
+        std::vector<std::shared_ptr<const AnyLogMessage>> messages;
+    };
+
+    FluxSource& _fluxSource;
+    Decoder& _decoder;
+    std::vector<std::shared_ptr<const TrackInfo>>& _locations;
+    std::vector<std::unique_ptr<Decoder>> _decoders;
+    std::unique_ptr<PipelinedFluxSource> _pipeline;
+    bool _deferRetries = false;
+    std::mutex _fluxSourceMutex;
+    std::deque<std::future<DecodedTrack>> _pending;
+    unsigned _queued = 0;
+    unsigned _consumed = 0;
+};
+
+/* Does everything which needs doing to a track once it's been read for the
+ * last time. */
+
+static void finishReadingTrack(DiskFlux& diskflux,
+    FluxSink* outputFluxSink,
+    const std::shared_ptr<TrackFlux>& trackFlux)
+{
+    diskflux.tracks.push_back(trackFlux);
+
+    if (outputFluxSink)
+    {
+        for (const auto& data : trackFlux->trackDatas)
+            outputFluxSink->writeFlux(trackFlux->trackInfo->physicalTrack,
+                trackFlux->trackInfo->physicalSide,
+                *data->fluxmap);
+    }
+
+    if (globalConfig()->decoder().dump_records())
+    {
+        std::vector<std::shared_ptr<const Record>> sorted_records;
+
+        for (const auto& data : trackFlux->trackDatas)
+            sorted_records.insert(sorted_records.end(),
+                data->records.begin(),
+                data->records.end());
+
+        std::sort(sorted_records.begin(),
+            sorted_records.end(),
+            [](const auto& o1, const auto& o2)
+            {
+                return o1->startTime < o2->startTime;
+            });
+
+        std::cout << "\nRaw (undecoded) records follow:\n\n";
+        for (const auto& record : sorted_records)
+        {
+            std::cout << fmt::format("I+{:.2f}us with {:.2f}us clock\n",
+                record->startTime / 1000.0,
+                record->clock / 1000.0);
+            hexdump(std::cout, record->rawData);
+            std::cout << std::endl;
+        }
+    }
+
+    if (globalConfig()->decoder().dump_sectors())
+    {
+        auto collected_sectors = collectSectors(trackFlux->sectors, false);
+        std::vector<std::shared_ptr<const Sector>> sorted_sectors(
+            collected_sectors.begin(), collected_sectors.end());
+        std::sort(sorted_sectors.begin(),
+            sorted_sectors.end(),
+            [](const auto& o1, const auto& o2)
+            {
+                return *o1 < *o2;
+            });
+
+        std::cout << "\nDecoded sectors follow:\n\n";
+        for (const auto& sector : sorted_sectors)
+        {
+            std::cout << fmt::format(
+                "{}.{:02}.{:02}: I+{:.2f}us with {:.2f}us clock: "
+                "status {}\n",
+                sector->logicalTrack,
+                sector->logicalSide,
+                sector->logicalSector,
+                sector->headerStartTime / 1000.0,
+                sector->clock / 1000.0,
+                Sector::statusToString(sector->status));
+            hexdump(std::cout, sector->data);
+            std::cout << std::endl;
+        }
+    }
+
+    /* track can't be modified below this point. */
+    log(TrackReadLogMessage{trackFlux});
+}
+
+std::shared_ptr<const DiskFlux> readDiskCommand(
+    FluxSource& fluxSource, Decoder& decoder)
+{
+    std::unique_ptr<FluxSink> outputFluxSink;
+    if (globalConfig()->decoder().has_copy_flux_to())
+        outputFluxSink =
+            FluxSink::create(globalConfig()->decoder().copy_flux_to());
+
+    auto diskflux = std::make_shared<DiskFlux>();
+
+    log(BeginOperationLogMessage{"Reading and decoding disk"});
+    auto locations = scheduleLocations(Layout::computeLocations());
+    TrackDecoderPool pool(fluxSource, decoder, locations);
+    std::vector<std::shared_ptr<TrackFlux>> deferred;
+    for (unsigned index = 0; index < locations.size(); index++)
+    {
+        log(OperationProgressLogMessage{
+            index * 100 / (unsigned)locations.size()});
+
+        testForEmergencyStop();
+
+        std::vector<std::shared_ptr<const AnyLogMessage>> messages;
+        auto trackFlux = pool.next(messages);
+        for (const auto& message : messages)
+            log(message);
+
+        if (pool.defersRetries() &&
+            (getBadSectorsState(*trackFlux) == HAS_BAD_SECTORS))
+            deferred.push_back(trackFlux);
+        else
+            finishReadingTrack(*diskflux, outputFluxSink.get(), trackFlux);
+    }
+
+    /* Sweep back over any bad tracks, starting with the one nearest to where
+     * the head has ended up. */
+
+    std::reverse(deferred.begin(), deferred.end());
+    for (auto& trackFlux : deferred)
+    {
+        testForEmergencyStop();
+
+        pool.retry(*trackFlux);
+        finishReadingTrack(*diskflux, outputFluxSink.get(), trackFlux);
     }
 
     std::set<std::shared_ptr<const Sector>> all_sectors;
@@ -613,7 +1478,7 @@ void rawReadDiskCommand(FluxSource& fluxsource, FluxSink& fluxsink)
 
     if (fluxsource.isHardware() || fluxsink.isHardware())
         measureDiskRotation();
-    auto locations = Layout::computeLocations();
+    auto locations = scheduleLocations(Layout::computeLocations());
     unsigned index = 0;
     for (auto& trackInfo : locations)
     {
@@ -3,8 +3,10 @@
 #include "protocol.h"
 #include "lib/fluxmap.h"
 #include "lib/bytes.h"
+#include "lib/proto.h"
 #include "libusbp_config.h"
 #include "libusbp.hpp"
+#include <thread>
 
 #define MAX_TRANSFER (32 * 1024)
 
@@ -32,6 +34,17 @@ private:
         _handle.read_pipe(FLUXENGINE_CMD_IN_EP, ptr, len, &rlen);
     }
 
+    /* Data is moved in MAX_TRANSFER sized transfers. When reading,
+     * usb.queue_depth of them can be kept in flight at once so that the
+     * device never has to wait for the host to get round to issuing the next
+     * one. libusbp has no asynchronous API for writes, so those are always
+     * synchronous. */
+
+    static unsigned queue_depth()
+    {
+        return std::max(1, globalConfig()->usb().queue_depth());
+    }
+
     void usb_data_send(const Bytes& bytes)
     {
         size_t ptr = 0;
@@ -46,7 +59,76 @@ private:
         }
     }
 
+    /* Reads until either the buffer is full or the device ends the transfer
+     * with a short packet. */
+
     void usb_data_recv(Bytes& bytes)
+    {
+        if (queue_depth() == 1)
+            usb_data_recv_sync(bytes);
+        else
+            usb_data_recv_async(bytes);
+    }
+
+    void usb_data_recv_async(Bytes& bytes)
+    {
+        auto pipe = _handle.open_async_in_pipe(FLUXENGINE_DATA_IN_EP);
+        pipe.allocate_transfers(queue_depth(), MAX_TRANSFER);
+        pipe.start_endless_transfers();
+
+        Bytes transfer(MAX_TRANSFER);
+        size_t ptr = 0;
+        libusbp::error transferError;
+        bool finished = false;
+        while (!finished && !transferError)
+        {
+            pipe.handle_events();
+
+            size_t rlen;
+            bool handled = false;
+            while (!finished && !transferError &&
+                   pipe.handle_finished_transfer(
+                       transfer.begin(), &rlen, &transferError))
+            {
+                handled = true;
+                if (transferError)
+                    break;
+
+                size_t len = std::min(rlen, bytes.size() - ptr);
+                std::copy(transfer.cbegin(),
+                    transfer.cbegin() + len,
+                    bytes.begin() + ptr);
+                ptr += len;
+                finished = (rlen < MAX_TRANSFER) || (ptr == bytes.size());
+            }
+
+            /* libusbp can only poll for finished transfers, not block
+             * waiting for them; yield rather than sleep so that a transfer
+             * which has just finished is picked up (and its slot requeued)
+             * straight away. */
+
+            if (!handled)
+                std::this_thread::yield();
+        }
+
+        /* The transfers which are still queued won't receive anything, as the
+         * device has finished sending, but they have to be reaped before the
+         * pipe can go away. */
+
+        pipe.cancel_transfers();
+        while (pipe.has_pending_transfers())
+        {
+            pipe.handle_events();
+            while (pipe.handle_finished_transfer(nullptr, nullptr, nullptr))
+                ;
+        }
+
+        if (transferError)
+            throw transferError;
+        bytes.resize(ptr);
+    }
+
+    void usb_data_recv_sync(Bytes& bytes)
     {
         size_t ptr = 0;
         while (ptr < bytes.size())
@@ -4,81 +4,132 @@
 #include "lib/bytes.h"
 #include "greaseweazle.h"
 
-Bytes fluxEngineToGreaseweazle(const Bytes& fldata, nanoseconds_t clock)
+/* The Greaseweazle's sample clock is an integer frequency, so rescaling
+ * between it and the FluxEngine tick rate can be done exactly. */
+
+static uint32_t toSampleFrequency(nanoseconds_t clock)
 {
-    Bytes gwdata;
-    ByteWriter bw(gwdata);
-    ByteReader br(fldata);
-    uint32_t ticks_fl = 0;
-    uint32_t ticks_gw = 0;
+    return llround(1e9 / clock);
+}
+
+void fluxEngineToGreaseweazle(const Bytes& fldata,
+    uint32_t sampleFrequency,
+    const std::function<void(const uint8_t*, size_t)>& writer)
+{
+    /* Enough for any one interval, with room to spare. */
+
+    static constexpr size_t CHUNK_SIZE = 4096;
+    uint8_t buffer[CHUNK_SIZE + 16];
+    size_t fill = 0;
 
     auto write_28 = [&](uint32_t val)
     {
-        bw.write_8(1 | (val << 1) & 0xff);
-        bw.write_8(1 | (val >> 6) & 0xff);
-        bw.write_8(1 | (val >> 13) & 0xff);
-        bw.write_8(1 | (val >> 20) & 0xff);
+        buffer[fill++] = 1 | (val << 1) & 0xff;
+        buffer[fill++] = 1 | (val >> 6) & 0xff;
+        buffer[fill++] = 1 | (val >> 13) & 0xff;
+        buffer[fill++] = 1 | (val >> 20) & 0xff;
     };
 
-    while (!br.eof())
+    uint64_t ticks_fl = 0;
+    uint32_t ticks_gw = 0;
+    for (uint8_t b : fldata)
     {
-        uint8_t b = br.read_8();
         ticks_fl += b & 0x3f;
         if (b & F_BIT_PULSE)
         {
-            uint32_t newticks_gw = ticks_fl * NS_PER_TICK / clock;
+            uint32_t newticks_gw = ticks_fl * sampleFrequency / TICK_FREQUENCY;
             uint32_t delta = newticks_gw - ticks_gw;
             if (delta < 250)
-                bw.write_8(delta);
+                buffer[fill++] = delta;
             else
             {
                 int high = (delta - 250) / 255;
                 if (high < 5)
                 {
-                    bw.write_8(250 + high);
-                    bw.write_8(1 + (delta - 250) % 255);
+                    buffer[fill++] = 250 + high;
+                    buffer[fill++] = 1 + (delta - 250) % 255;
                 }
                 else
                 {
-                    bw.write_8(255);
-                    bw.write_8(FLUXOP_SPACE);
+                    buffer[fill++] = 255;
+                    buffer[fill++] = FLUXOP_SPACE;
                     write_28(delta - 249);
-                    bw.write_8(249);
+                    buffer[fill++] = 249;
                 }
             }
             ticks_gw = newticks_gw;
+
+            if (fill >= CHUNK_SIZE)
+            {
+                writer(buffer, fill);
+                fill = 0;
+            }
         }
     }
-    bw.write_8(0); /* end of stream */
+    buffer[fill++] = 0; /* end of stream */
+    writer(buffer, fill);
+}
+
+Bytes fluxEngineToGreaseweazle(const Bytes& fldata, nanoseconds_t clock)
+{
+    Bytes gwdata;
+    ByteWriter bw(gwdata);
+    fluxEngineToGreaseweazle(fldata,
+        toSampleFrequency(clock),
+        [&](const uint8_t* buffer, size_t len)
+        {
+            bw += Bytes(buffer, len);
+        });
     return gwdata;
 }
 
-Bytes greaseWeazleToFluxEngine(const Bytes& gwdata, nanoseconds_t clock)
+Bytes greaseWeazleToFluxEngine(
+    const std::function<uint8_t()>& reader, uint32_t sampleFrequency)
 {
-    Bytes fldata;
-    ByteReader br(gwdata);
-    ByteWriter bw(fldata);
+    auto fldata = std::make_shared<std::vector<uint8_t>>();
+    fldata->reserve(64 * 1024);
 
     auto read_28 = [&]()
     {
-        return ((br.read_8() & 0xfe) >> 1) | ((br.read_8() & 0xfe) << 6) |
-               ((br.read_8() & 0xfe) << 13) | ((br.read_8() & 0xfe) << 20);
+        uint32_t b0 = reader();
+        uint32_t b1 = reader();
+        uint32_t b2 = reader();
+        uint32_t b3 = reader();
+        return ((b0 & 0xfe) >> 1) | ((b1 & 0xfe) << 6) | ((b2 & 0xfe) << 13) |
+               ((b3 & 0xfe) << 20);
+    };
+
+    /* Rounds to the nearest FluxEngine tick. */
+
+    auto to_fl = [&](uint64_t ticks_gw) -> uint32_t
+    {
+        return (ticks_gw * TICK_FREQUENCY + sampleFrequency / 2) /
+               sampleFrequency;
+    };
+
+    auto write_interval = [&](uint32_t delta_fl, uint8_t event)
+    {
+        while (delta_fl > 0x3f)
+        {
+            fldata->push_back(0x3f);
+            delta_fl -= 0x3f;
+        }
+        fldata->push_back(delta_fl | event);
     };
 
     uint32_t ticks_gw = 0;
     uint32_t lastevent_fl = 0;
     uint32_t index_gw = ~0;
 
-    while (!br.eof())
+    for (;;)
     {
-        uint8_t b = br.read_8();
+        uint8_t b = reader();
         if (!b)
             break;
 
-        uint8_t event = 0;
         if (b == 255)
         {
-            switch (br.read_8())
+            switch (reader())
             {
                 case FLUXOP_INDEX:
                     index_gw = ticks_gw + read_28();
@@ -91,53 +142,52 @@ Bytes greaseWeazleToFluxEngine(const Bytes& gwdata, nanoseconds_t clock)
                 default:
                     error("bad opcode in Greaseweazle stream");
             }
+            continue;
         }
+
+        if (b < 250)
+            ticks_gw += b;
         else
         {
-            if (b < 250)
-                ticks_gw += b;
-            else
-            {
-                int delta = 250 + (b - 250) * 255 + br.read_8() - 1;
-                ticks_gw += delta;
-            }
-            event = F_BIT_PULSE;
+            int delta = 250 + (b - 250) * 255 + reader() - 1;
+            ticks_gw += delta;
         }
 
-        if (event)
+        uint8_t event = F_BIT_PULSE;
+        uint32_t ticks_fl = to_fl(ticks_gw);
+        if (index_gw != ~0)
         {
-            uint32_t index_fl = round((index_gw * clock) / NS_PER_TICK);
-            uint32_t ticks_fl = round((ticks_gw * clock) / NS_PER_TICK);
-            if (index_gw != ~0)
-            {
-                if (index_fl < ticks_fl)
-                {
-                    uint32_t delta_fl = index_fl - lastevent_fl;
-                    while (delta_fl > 0x3f)
-                    {
-                        bw.write_8(0x3f);
-                        delta_fl -= 0x3f;
-                    }
-                    bw.write_8(delta_fl | F_BIT_INDEX);
-                    lastevent_fl = index_fl;
-                    index_gw = ~0;
-                }
-                else if (index_fl == ticks_fl)
-                    event |= F_BIT_INDEX;
-            }
-
-            uint32_t delta_fl = ticks_fl - lastevent_fl;
-            while (delta_fl > 0x3f)
+            uint32_t index_fl = to_fl(index_gw);
+            if (index_fl < ticks_fl)
             {
-                bw.write_8(0x3f);
-                delta_fl -= 0x3f;
+                write_interval(index_fl - lastevent_fl, F_BIT_INDEX);
+                lastevent_fl = index_fl;
+                index_gw = ~0;
             }
-            bw.write_8(delta_fl | event);
-            lastevent_fl = ticks_fl;
+            else if (index_fl == ticks_fl)
+                event |= F_BIT_INDEX;
         }
+
+        write_interval(ticks_fl - lastevent_fl, event);
+        lastevent_fl = ticks_fl;
     }
 
-    return fldata;
+    return Bytes(fldata);
+}
+
+Bytes greaseWeazleToFluxEngine(const Bytes& gwdata, nanoseconds_t clock)
+{
+    ByteReader br(gwdata);
+    return greaseWeazleToFluxEngine(
+        [&]() -> uint8_t
+        {
+            /* A stream without a terminator ends at the end of the data. */
+
+            if (br.eof())
+                return 0;
+            return br.read_8();
+        },
+        toSampleFrequency(clock));
 }
 
 /* Left-truncates at the first index mark, so the resulting data as aligned at
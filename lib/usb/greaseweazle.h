@@ -11,6 +11,16 @@
 
 extern Bytes fluxEngineToGreaseweazle(const Bytes& fldata, nanoseconds_t clock);
 extern Bytes greaseWeazleToFluxEngine(const Bytes& gwdata, nanoseconds_t clock);
+
+/* Streaming versions of the above, which hand the Greaseweazle data over in
+ * chunks as it's produced, or pull it in a byte at a time as it's consumed,
+ * rather than holding the whole stream in memory. */
+
+extern void fluxEngineToGreaseweazle(const Bytes& fldata,
+    uint32_t sampleFrequency,
+    const std::function<void(const uint8_t*, size_t)>& writer);
+extern Bytes greaseWeazleToFluxEngine(
+    const std::function<uint8_t()>& reader, uint32_t sampleFrequency);
 extern Bytes stripPartialRotation(const Bytes& fldata);
 
 /* Copied from
@@ -117,8 +117,8 @@ public:
         ByteReader br(response);
 
         br.seek(4);
-        nanoseconds_t freq = br.read_le32();
-        _clock = 1000000000 / freq;
+        _sampleFrequency = br.read_le32();
+        _clock = 1000000000.0 / _sampleFrequency;
 
         br.seek(0);
         return br.read_be16();
@@ -344,19 +344,15 @@ public:
             }
         }
 
-        Bytes buffer;
-        ByteWriter bw(buffer);
-        for (;;)
-        {
-            uint8_t b = _serial->readByte();
-            if (!b)
-                break;
-            bw.write_8(b);
-        }
+        Bytes fldata = greaseWeazleToFluxEngine(
+            [&]()
+            {
+                return _serial->readByte();
+            },
+            _sampleFrequency);
 
         do_command({CMD_GET_FLUX_STATUS, 2});
 
-        Bytes fldata = greaseWeazleToFluxEngine(buffer, _clock);
         if (synced)
             fldata = stripPartialRotation(fldata);
         return fldata;
@@ -379,7 +375,12 @@ public:
                 do_command({CMD_WRITE_FLUX, 4, 1, 1});
                 break;
         }
-        _serial->write(fluxEngineToGreaseweazle(fldata, _clock));
+        fluxEngineToGreaseweazle(fldata,
+            _sampleFrequency,
+            [&](const uint8_t* buffer, size_t len)
+            {
+                _serial->write(buffer, len);
+            });
         _serial->readByte(); /* synchronise */
 
         do_command({CMD_GET_FLUX_STATUS, 2});
@@ -427,6 +428,7 @@ private:
     const GreaseweazleProto& _config;
     int _version;
     nanoseconds_t _clock;
+    uint32_t _sampleFrequency;
     nanoseconds_t _revolutions;
 };
 
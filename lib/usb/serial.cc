@@ -38,8 +38,15 @@ public:
             .StopBits = ONESTOPBIT};
         SetCommState(_handle, &dcb);
 
+        /* Make ReadFile() return as soon as anything has arrived, with
+         * whatever is queued, rather than waiting for the whole buffer to
+         * fill; if nothing arrives it gives up after 100ms and returns no
+         * data. */
+
         COMMTIMEOUTS commtimeouts = {0};
-        commtimeouts.ReadIntervalTimeout = 100;
+        commtimeouts.ReadIntervalTimeout = MAXDWORD;
+        commtimeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+        commtimeouts.ReadTotalTimeoutConstant = 100;
         SetCommTimeouts(_handle, &commtimeouts);
 
         if (!EscapeCommFunction(_handle, CLRDTR))
@@ -72,7 +79,7 @@ public:
         return rlen;
     }
 
-    ssize_t write(const uint8_t* buffer, size_t len) override
+    ssize_t writeImpl(const uint8_t* buffer, size_t len) override
     {
         DWORD wlen;
         /* Windows gets unhappy if we try to transfer too much... */
@@ -184,7 +191,7 @@ public:
         return rlen;
     }
 
-    ssize_t write(const uint8_t* buffer, size_t len) override
+    ssize_t writeImpl(const uint8_t* buffer, size_t len) override
     {
         ssize_t wlen = ::write(_fd, buffer, len);
         if (wlen == -1)
@@ -207,15 +214,45 @@ private:
 
 SerialPort::~SerialPort() {}
 
+void SerialPort::fillReadBuffer()
+{
+    /* Anything we're waiting for is probably a reply to something we haven't
+     * sent yet. */
+
+    flush();
+
+    /* readImpl() may time out and return nothing on some platforms. */
+
+    _readbuffer_ptr = 0;
+    do
+        _readbuffer_fill = this->readImpl(_readbuffer, sizeof(_readbuffer));
+    while (_readbuffer_fill == 0);
+}
+
 void SerialPort::read(uint8_t* buffer, size_t len)
 {
     while (len != 0)
     {
-        // std::cout << "want " << len << " " << std::flush;
-        size_t rlen = this->readImpl(buffer, len);
-        // std::cout << "got " << rlen << "\n" << std::flush;
-        buffer += rlen;
-        len -= rlen;
+        size_t buffered = _readbuffer_fill - _readbuffer_ptr;
+        if (buffered)
+        {
+            size_t blen = std::min(buffered, len);
+            memcpy(buffer, _readbuffer + _readbuffer_ptr, blen);
+            _readbuffer_ptr += blen;
+            buffer += blen;
+            len -= blen;
+        }
+        else if (len >= sizeof(_readbuffer))
+        {
+            /* Big reads go straight into the caller's buffer. */
+
+            flush();
+            size_t rlen = this->readImpl(buffer, len);
+            buffer += rlen;
+            len -= rlen;
+        }
+        else
+            fillReadBuffer();
     }
 }
 
@@ -231,21 +268,42 @@ Bytes SerialPort::readBytes(size_t len)
     return b;
 }
 
-uint8_t SerialPort::readByte()
+void SerialPort::write(const uint8_t* buffer, size_t len)
 {
-    uint8_t b;
-    this->read(&b, 1);
-    return b;
+    if ((_writebuffer_fill + len) > sizeof(_writebuffer))
+        flush();
+
+    if (len >= sizeof(_writebuffer))
+    {
+        while (len != 0)
+        {
+            ssize_t wlen = this->writeImpl(buffer, len);
+            buffer += wlen;
+            len -= wlen;
+        }
+    }
+    else
+    {
+        memcpy(_writebuffer + _writebuffer_fill, buffer, len);
+        _writebuffer_fill += len;
+    }
 }
 
 void SerialPort::write(const Bytes& bytes)
 {
-    int ptr = 0;
-    while (ptr < bytes.size())
+    this->write(bytes.cbegin(), bytes.size());
+}
+
+void SerialPort::flush()
+{
+    size_t ptr = 0;
+    while (ptr < _writebuffer_fill)
     {
-        ssize_t wlen = this->write(bytes.cbegin() + ptr, bytes.size() - ptr);
+        ssize_t wlen =
+            this->writeImpl(_writebuffer + ptr, _writebuffer_fill - ptr);
         ptr += wlen;
     }
+    _writebuffer_fill = 0;
 }
 
 std::unique_ptr<SerialPort> SerialPort::openSerialPort(const std::string& path)
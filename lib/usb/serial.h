@@ -1,6 +1,13 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
+/* A serial port with buffering in both directions. Reads pull in whatever
+ * the device has available in one go (readImpl() returns as soon as anything
+ * has arrived), so that reading a byte at a time only costs a system call
+ * every so often. Writes are collected until either the
+ * buffer fills up or something is read (which is always when the device is
+ * expected to have seen everything written so far), or flush() is called. */
+
 class SerialPort
 {
 public:
@@ -9,19 +16,36 @@ public:
 public:
     virtual ~SerialPort();
     virtual ssize_t readImpl(uint8_t* buffer, size_t len) = 0;
-    virtual ssize_t write(const uint8_t* buffer, size_t len) = 0;
+    virtual ssize_t writeImpl(const uint8_t* buffer, size_t len) = 0;
     virtual void setBaudRate(int baudRate) = 0;
 
     void read(uint8_t* buffer, size_t len);
     void read(Bytes& bytes);
     Bytes readBytes(size_t count);
-    uint8_t readByte();
+
+    uint8_t readByte()
+    {
+        if (_readbuffer_ptr == _readbuffer_fill)
+            fillReadBuffer();
+        return _readbuffer[_readbuffer_ptr++];
+    }
+
+    void write(const uint8_t* buffer, size_t len);
     void write(const Bytes& bytes);
+    void flush();
 
 private:
-    uint8_t _readbuffer[4096];
+    void fillReadBuffer();
+
+private:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    uint8_t _readbuffer[BUFFER_SIZE];
     size_t _readbuffer_ptr = 0;
     size_t _readbuffer_fill = 0;
+
+    uint8_t _writebuffer[BUFFER_SIZE];
+    size_t _writebuffer_fill = 0;
 };
 
 #endif
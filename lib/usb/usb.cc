@@ -12,6 +12,7 @@
 #include "greaseweazle.h"
 
 static USB* usb = NULL;
+static std::string usbSerial;
 
 USB::~USB() {}
 
@@ -68,12 +69,14 @@ USB* get_usb_impl()
     {
         const auto& conf = globalConfig()->usb().greaseweazle();
         log("Using Greaseweazle on serial port {}", conf.port());
+        usbSerial = conf.port();
         return createGreaseweazleUsb(conf.port(), conf);
     }
 
     /* Otherwise, select a device by USB ID. */
 
     auto candidate = selectDevice();
+    usbSerial = candidate->serial;
     switch (candidate->id)
     {
         case FLUXENGINE_ID:
@@ -98,3 +101,9 @@ USB& getUsb()
         usb = get_usb_impl();
     return *usb;
 }
+
+std::string getUsbSerial()
+{
+    getUsb();
+    return usbSerial;
+}
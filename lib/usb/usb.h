@@ -38,6 +38,11 @@ protected:
 
 extern USB& getUsb();
 
+/* Returns the serial number of the device in use (or, for a Greaseweazle
+ * opened by port, the port name). */
+
+extern std::string getUsbSerial();
+
 extern USB* createFluxengineUsb(libusbp::device& device);
 extern USB* createGreaseweazleUsb(
     const std::string& serialPort, const GreaseweazleProto& config);
@@ -218,7 +218,7 @@ int mainInspect(int argc, const char* argv[])
             "\n\nAligned bitstream from {:.3f}ms follows:\n",
             fmr.tell().ns() / 1000000.0);
 
-        FluxDecoder decoder(&fmr, clockPeriod, globalConfig()->decoder());
+        FluxDecoder decoder(&fmr, clockPeriod, fmr.params());
         while (!fmr.eof())
         {
             std::cout << fmt::format("{:06x} {: 10.3f} : ",
@@ -243,7 +243,7 @@ int mainInspect(int argc, const char* argv[])
             dumpRawFlag.get(),
             fmr.tell().ns() / 1000000.0);
 
-        FluxDecoder decoder(&fmr, clockPeriod, globalConfig()->decoder());
+        FluxDecoder decoder(&fmr, clockPeriod, fmr.params());
         for (int i = 0; i < dumpRawFlag; i++)
             decoder.readBit();
 
@@ -1,13 +1,23 @@
 #include "lib/globals.h"
 #include "lib/flags.h"
+#include "lib/proto.h"
 #include "lib/usb/usb.h"
 
 static FlagGroup flags;
 
+static IntFlag maxQueueDepth({"--max-queue-depth"},
+    "test reads with queue depths of 1, 2, 4... up to this many transfers",
+    8);
+
 int mainTestBandwidth(int argc, const char* argv[])
 {
     flags.parseFlagsWithConfigFiles(argc, argv, {});
     usbTestBulkWrite();
-    usbTestBulkRead();
+    for (int depth = 1; depth <= maxQueueDepth; depth *= 2)
+    {
+        std::cout << fmt::format("Queue depth {}:\n", depth);
+        globalConfig().setTransient("usb.queue_depth", std::to_string(depth));
+        usbTestBulkRead();
+    }
     return 0;
 }
@@ -7,7 +7,7 @@
 #include "layout.h"
 #include "jobqueue.h"
 
-static Bytes fakeBits(const std::vector<bool>& bits)
+static Bytes fakeBits(const RawBits& bits)
 {
     Bytes result;
     ByteWriter bw(result);
@@ -176,7 +176,7 @@ private:
 
                         nanoseconds_t clock =
                             explorerClockSpinCtrl->GetValue() * 1e3;
-                        FluxDecoder fluxDecoder(&fmr, clock, DecoderProto());
+                        FluxDecoder fluxDecoder(&fmr, clock, DecoderParams());
                         fluxDecoder.readBits(
                             explorerBitOffsetSpinCtrl->GetValue());
                         auto bits = fluxDecoder.readBits();
@@ -319,7 +319,7 @@ void FluxViewerControl::OnPaint(wxPaintEvent&)
                         FluxmapReader fmr(*trackdata->fluxmap);
                         fmr.seek({record->position, 0, 0});
 
-                        FluxDecoder fd(&fmr, record->clock, DecoderProto());
+                        FluxDecoder fd(&fmr, record->clock, DecoderParams());
                         while ((int)fmr.tell().ns() <=
                                (int)(record->endTime - record->startTime))
                         {
@@ -371,7 +371,7 @@ void FluxViewerControl::OnPaint(wxPaintEvent&)
                         FluxmapReader fmr(*trackdata->fluxmap);
                         fmr.seek({record->position, 0, 0});
 
-                        FluxDecoder fd(&fmr, record->clock, DecoderProto());
+                        FluxDecoder fd(&fmr, record->clock, DecoderParams());
                         std::string text;
                         while ((int)fmr.tell().ns() <=
                                (int)(record->endTime - record->startTime))
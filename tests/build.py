@@ -25,10 +25,13 @@ tests = [
     "bitaccumulator",
     "bytes",
     "compression",
+    "crc",
     "configs",
     "cpmfs",
     "csvreader",
+    "fl2",
     "flags",
+    "fluxdecoder",
     "fluxmapreader",
     "fluxpattern",
     "flx",
@@ -38,6 +41,7 @@ tests = [
     "layout",
     "ldbs",
     "options",
+    "rawbits",
     "utils",
     "vfs",
 ]
@@ -100,5 +104,24 @@ export(
             ),
         )
         for n in tests
+    ]
+    + [
+        cxxprogram(
+            name="fluxmapbenchmark",
+            srcs=["./fluxmapbenchmark.cc"],
+            deps=[
+                "+fl2_proto_lib",
+                "+protocol",
+                "dep/adflib",
+                "dep/agg",
+                "dep/fatfs",
+                "dep/hfsutils",
+                "dep/libusbp",
+                "dep/stb",
+                "+lib",
+                "lib+config_proto_lib",
+                "src/formats",
+            ],
+        )
     ],
 )
@@ -0,0 +1,179 @@
+#include "lib/globals.h"
+#include "lib/bytes.h"
+#include "lib/crc.h"
+#include <assert.h>
+
+/* The original bit-at-a-time implementations, which the table-driven ones
+ * must match exactly. */
+
+template <class T>
+static T referenceReflect(T bin, unsigned width = sizeof(T) * 8)
+{
+    T bout = 0;
+    while (width--)
+    {
+        bout <<= 1;
+        bout |= (bin & 1);
+        bin >>= 1;
+    }
+    return bout;
+}
+
+static uint64_t referenceGenericCrc(const crcspec& spec, const Bytes& bytes)
+{
+    uint64_t crc = spec.init;
+    uint64_t top = 1LL << (spec.width - 1);
+    uint64_t mask = (top << 1) - 1;
+
+    for (uint8_t b : bytes)
+    {
+        if (spec.refin)
+            b = referenceReflect(b);
+
+        for (uint8_t i = 0x80; i != 0; i >>= 1)
+        {
+            uint64_t bit = crc & top;
+            crc <<= 1;
+            if (b & i)
+                bit ^= top;
+            if (bit)
+                crc ^= spec.poly;
+        }
+    }
+
+    if (spec.refout)
+        crc = referenceReflect(crc, spec.width);
+    crc ^= spec.xorout;
+    return crc & mask;
+}
+
+static uint16_t referenceCrc16(uint16_t poly, uint16_t crc, const Bytes& bytes)
+{
+    for (uint8_t b : bytes)
+    {
+        crc ^= b << 8;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? ((crc << 1) ^ poly) : (crc << 1);
+    }
+    return crc;
+}
+
+static uint16_t referenceCrc16ref(
+    uint16_t poly, uint16_t crc, const Bytes& bytes)
+{
+    for (uint8_t b : bytes)
+    {
+        crc ^= b;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x0001) ? ((crc >> 1) ^ poly) : (crc >> 1);
+    }
+    return crc;
+}
+
+static uint32_t referenceCrcBrother(const Bytes& bytes)
+{
+    ByteReader br(bytes);
+
+    uint32_t crc = br.read_8();
+    while (!br.eof())
+    {
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x800000) ? ((crc << 1) ^ BROTHER_POLY) : (crc << 1);
+        crc ^= br.read_8();
+    }
+
+    return crc & 0xFFFFFF;
+}
+
+static Bytes randomBytes(unsigned count)
+{
+    Bytes bytes;
+    ByteWriter bw(bytes);
+    for (unsigned i = 0; i < count; i++)
+        bw.write_8(rand());
+    return bytes;
+}
+
+static uint64_t random64()
+{
+    return ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31) ^ rand();
+}
+
+static void test_knownvalues()
+{
+    Bytes check("123456789");
+
+    assert(crc16(CCITT_POLY, check) == 0x29b1);
+    assert(crc16ref(MODBUS_POLY_REF, check) == 0x4b37);
+    assert(generic_crc({32, 0x04c11db7, 0xffffffff, 0xffffffff, true, true},
+               check) == 0xcbf43926);
+    assert(generic_crc({64,
+                           0x42f0e1eba9ea3693,
+                           0xffffffffffffffff,
+                           0xffffffffffffffff,
+                           true,
+                           true},
+               check) == 0x995dc9bbdf1939fa);
+}
+
+static void test_equivalence()
+{
+    for (int i = 0; i < 2000; i++)
+    {
+        Bytes data = randomBytes(rand() % 100);
+        uint16_t init = rand();
+
+        for (uint16_t poly : {CCITT_POLY, MODBUS_POLY, 0xa097})
+            assert(
+                crc16(poly, init, data) == referenceCrc16(poly, init, data));
+        for (uint16_t poly : {MODBUS_POLY_REF, 0x8408})
+            assert(crc16ref(poly, init, data) ==
+                   referenceCrc16ref(poly, init, data));
+
+        if (!data.empty())
+            assert(crcbrother(data) == referenceCrcBrother(data));
+
+        crcspec spec;
+        spec.width = 1 + (rand() % 64);
+        spec.poly = random64();
+        spec.init = random64();
+        spec.xorout = random64();
+        spec.refin = rand() & 1;
+        spec.refout = rand() & 1;
+        assert(generic_crc(spec, data) == referenceGenericCrc(spec, data));
+    }
+}
+
+static void test_streaming()
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        Bytes data = randomBytes(rand() % 100);
+
+        for (crcspec spec :
+            {crc16spec(CCITT_POLY), crc16refspec(MODBUS_POLY_REF)})
+        {
+            CrcState crc(spec);
+            unsigned pos = 0;
+            while (pos < data.size())
+            {
+                unsigned len =
+                    std::min<unsigned>(rand() % 20, data.size() - pos);
+                if (len == 1)
+                    crc.update(data[pos]);
+                else
+                    crc.update(data.slice(pos, len));
+                pos += len;
+            }
+            assert(crc.value() == generic_crc(spec, data));
+        }
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    test_knownvalues();
+    test_equivalence();
+    test_streaming();
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include "lib/globals.h"
+#include "lib/bytes.h"
+#include "lib/fl2.h"
+#include "lib/fl2.pb.h"
+#include "snowhouse/snowhouse.h"
+#include <filesystem>
+
+using namespace snowhouse;
+
+static std::string tempFilename()
+{
+    return (std::filesystem::temp_directory_path() / "fl2_test.fl2").string();
+}
+
+static FluxFileProto makeProto(FluxFileVersion version)
+{
+    FluxFileProto proto;
+    proto.set_version(version);
+    proto.set_rotational_period_ms(200.0);
+    proto.set_drive_type(DRIVETYPE_80TRACK);
+
+    for (int track = 0; track < 3; track++)
+    {
+        auto* t = proto.add_track();
+        t->set_track(track);
+        t->set_head(1);
+        for (int i = 0; i <= track; i++)
+            t->add_flux(std::string(100 * (track + 1), (char)(0x80 + i)));
+    }
+
+    return proto;
+}
+
+static void test_roundtrip(FluxFileVersion version)
+{
+    std::string filename = tempFilename();
+    FluxFileProto written = makeProto(version);
+    saveFl2File(filename, written);
+
+    {
+        Fl2FileReader reader(filename);
+        AssertThat((int)reader.proto().version(), Equals((int)version));
+        AssertThat(reader.proto().rotational_period_ms(), Equals(200.0));
+        AssertThat(reader.findTrack(0, 0) == nullptr, Equals(true));
+
+        /* Read the tracks out of order. */
+
+        for (int track = 2; track >= 0; track--)
+        {
+            const auto* t = reader.findTrack(track, 1);
+            AssertThat(t != nullptr, Equals(true));
+            AssertThat(reader.fluxCount(*t), Equals(track + 1));
+            for (int i = 0; i <= track; i++)
+                AssertThat(reader.readFlux(*t, i),
+                    Equals(Bytes(
+                        std::string(100 * (track + 1), (char)(0x80 + i)))));
+        }
+    }
+
+    FluxFileProto read = loadFl2File(filename);
+    AssertThat((int)read.version(), Equals((int)FluxFileVersion::VERSION_2));
+    AssertThat(read.chunk_data_size(), Equals(0));
+    AssertThat(read.track_size(), Equals(3));
+    for (int track = 0; track < 3; track++)
+    {
+        AssertThat(read.track(track).chunk_size(), Equals(0));
+        AssertThat(read.track(track).flux_size(),
+            Equals(written.track(track).flux_size()));
+        for (int i = 0; i <= track; i++)
+            AssertThat(read.track(track).flux(i),
+                Equals(written.track(track).flux(i)));
+    }
+
+    std::filesystem::remove(filename);
+}
+
+static void test_compatibility()
+{
+    /* A version 3 file is still a valid protobuf, so older clients will see
+     * the version number and complain. */
+
+    std::string filename = tempFilename();
+    FluxFileProto written = makeProto(FluxFileVersion::VERSION_3);
+    saveFl2File(filename, written);
+
+    FluxFileProto proto;
+    AssertThat(proto.ParseFromString(Bytes::readFromFile(filename)),
+        Equals(true));
+    AssertThat((int)proto.version(), Equals((int)FluxFileVersion::VERSION_3));
+    AssertThat(proto.chunk_data_size(), Equals(6));
+    AssertThat(proto.track(2).chunk_size(), Equals(3));
+    AssertThat(proto.has_index_offset(), Equals(true));
+
+    std::filesystem::remove(filename);
+}
+
+static Bytes makeFlux(int seed)
+{
+    return Bytes(std::string(50 + seed, (char)(0x80 + seed)));
+}
+
+static void test_streaming(FluxFileVersion version)
+{
+    std::string filename = tempFilename();
+    {
+        Fl2FileWriter writer(filename, version);
+        writer.writeFlux(0, 0, makeFlux(0));
+        writer.writeFlux(1, 0, makeFlux(1));
+        writer.writeFlux(0, 0, makeFlux(2));
+
+        FluxFileProto metadata;
+        metadata.set_rotational_period_ms(166.0);
+        writer.close(metadata);
+    }
+
+    Fl2FileReader reader(filename);
+    AssertThat(reader.proto().rotational_period_ms(), Equals(166.0));
+    const auto* t = reader.findTrack(0, 0);
+    AssertThat(reader.fluxCount(*t), Equals(2));
+    AssertThat(reader.readFlux(*t, 0), Equals(makeFlux(0)));
+    AssertThat(reader.readFlux(*t, 1), Equals(makeFlux(2)));
+    t = reader.findTrack(1, 0);
+    AssertThat(reader.fluxCount(*t), Equals(1));
+    AssertThat(reader.readFlux(*t, 0), Equals(makeFlux(1)));
+
+    std::filesystem::remove(filename);
+}
+
+static void test_recovery(FluxFileVersion version)
+{
+    /* The writer is never closed, and the last record is cut short. */
+
+    std::string filename = tempFilename();
+    {
+        Fl2FileWriter writer(filename, version);
+        writer.writeFlux(0, 0, makeFlux(0));
+        writer.writeFlux(1, 0, makeFlux(1));
+        writer.writeFlux(2, 0, makeFlux(2));
+        writer.writeFlux(3, 0, makeFlux(3));
+    }
+    std::filesystem::resize_file(
+        filename, std::filesystem::file_size(filename) - 10);
+
+    Fl2FileReader reader(filename);
+    AssertThat(reader.findTrack(0, 0) != nullptr, Equals(true));
+    AssertThat(reader.findTrack(1, 0) != nullptr, Equals(true));
+    AssertThat(reader.findTrack(3, 0) == nullptr, Equals(true));
+    const auto* t = reader.findTrack(1, 0);
+    AssertThat(reader.readFlux(*t, 0), Equals(makeFlux(1)));
+
+    std::filesystem::remove(filename);
+}
+
+static void test_garbage()
+{
+    /* Neither random data nor text should be taken for an empty flux file. */
+
+    std::string random;
+    uint32_t seed = 1;
+    for (int i = 0; i < 5000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        random += (char)(seed >> 24);
+    }
+
+    std::string filename = tempFilename();
+    for (const auto& contents : {std::string("this is not a flux file\n"),
+             std::string("\x08\x01\x10\x02\xde\xad\xbe\xef", 8),
+             random})
+    {
+        Bytes(contents).writeToFile(filename);
+
+        bool failed = false;
+        try
+        {
+            Fl2FileReader reader(filename);
+        }
+        catch (const ErrorException& e)
+        {
+            failed = true;
+        }
+        AssertThat(failed, Equals(true));
+    }
+
+    std::filesystem::remove(filename);
+}
+
+static void test_compact_encoding()
+{
+    std::string filename = tempFilename();
+    std::string flux = std::string(1, 0x85) + std::string(10000, 0x3f) +
+                       std::string(1, 0x80);
+
+    FluxFileProto written;
+    written.set_version(FluxFileVersion::VERSION_3);
+    written.set_flux_encoding(FLUXENCODING_COMPACT);
+    auto* t = written.add_track();
+    t->set_track(5);
+    t->set_head(0);
+    t->add_flux(flux);
+    saveFl2File(filename, written);
+
+    {
+        Fl2FileReader reader(filename);
+        AssertThat((int)reader.proto().flux_encoding(),
+            Equals((int)FLUXENCODING_COMPACT));
+        AssertThat(reader.readFlux(*reader.findTrack(5, 0), 0),
+            Equals(Bytes(flux)));
+    }
+
+    FluxFileProto read = loadFl2File(filename);
+    AssertThat((int)read.flux_encoding(), Equals((int)FLUXENCODING_BYTECODE));
+    AssertThat(read.track(0).flux(0), Equals(flux));
+
+    /* Older versions can't be told that the flux is compact. */
+
+    bool failed = false;
+    try
+    {
+        Fl2FileWriter writer(
+            filename, FluxFileVersion::VERSION_2, FLUXENCODING_COMPACT);
+    }
+    catch (const ErrorException& e)
+    {
+        failed = true;
+    }
+    AssertThat(failed, Equals(true));
+
+    std::filesystem::remove(filename);
+}
+
+int main(int argc, const char* argv[])
+{
+    try
+    {
+        test_roundtrip(FluxFileVersion::VERSION_2);
+        test_roundtrip(FluxFileVersion::VERSION_3);
+        test_compatibility();
+        test_streaming(FluxFileVersion::VERSION_2);
+        test_streaming(FluxFileVersion::VERSION_3);
+        test_recovery(FluxFileVersion::VERSION_2);
+        test_recovery(FluxFileVersion::VERSION_3);
+        test_garbage();
+        test_compact_encoding();
+    }
+    catch (const ErrorException& e)
+    {
+        std::cerr << e.message << '\n';
+        exit(1);
+    }
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "lib/globals.h"
+#include "lib/fluxmap.h"
+#include "lib/decoders/fluxmapreader.h"
+#include "lib/decoders/fluxdecoder.h"
+#include "lib/decoders/decoders.pb.h"
+#include <assert.h>
+
+/* Builds a flux stream for the given bits, which must start with a pulse,
+ * with some slow drift in the clock and some random jitter on each pulse, as
+ * a real drive would produce. */
+
+static Fluxmap makeFlux(const std::vector<bool>& bits, double bitcellTicks)
+{
+    Fluxmap fluxmap;
+    double now = 0;
+    double lastPulse = 0;
+    for (size_t i = 1; i < bits.size(); i++)
+    {
+        double drift = 1.0 + 0.02 * sin(i / 5000.0);
+        now += bitcellTicks * drift;
+        if (bits[i])
+        {
+            double jitter = ((rand() % 1000) / 1000.0 - 0.5) * 0.2;
+            double pulse = now + jitter * bitcellTicks;
+            unsigned ticks = lround(pulse - lastPulse);
+            fluxmap.appendInterval(ticks).appendPulse();
+            lastPulse += ticks;
+        }
+    }
+    return fluxmap;
+}
+
+static std::vector<bool> randomMfm(unsigned count)
+{
+    std::vector<bool> bits;
+    bool lastBit = true;
+    bits.push_back(true);
+    while (bits.size() < count)
+    {
+        bool bit = rand() & 1;
+        bits.push_back(!lastBit && !bit);
+        bits.push_back(bit);
+        lastBit = bit;
+    }
+    return bits;
+}
+
+static RawBits decode(
+    const Fluxmap& fluxmap, nanoseconds_t bitcell, bool fixedPoint)
+{
+    DecoderParams params;
+    params.fixedPointPll = fixedPoint;
+
+    FluxmapReader fmr(fluxmap);
+    FluxDecoder decoder(&fmr, bitcell, params);
+    return decoder.readBits();
+}
+
+static void test_bitexactness()
+{
+    for (double bitcellTicks : {12.0, 24.0, 48.0})
+    {
+        for (int i = 0; i < 10; i++)
+        {
+            auto bits = randomMfm(20000);
+            auto fluxmap = makeFlux(bits, bitcellTicks);
+            nanoseconds_t bitcell = bitcellTicks * NS_PER_TICK;
+
+            auto floatBits = decode(fluxmap, bitcell, false);
+            auto fixedBits = decode(fluxmap, bitcell, true);
+            assert(fixedBits == floatBits);
+
+            /* Check that the flux was actually decodable, or the above is
+             * meaningless. Decoding stops as soon as the last interval is
+             * read, so the final few bits are lost and the one before them
+             * is junk. */
+
+            assert(floatBits.size() > (bits.size() - 10));
+            for (size_t j = 0; j < (floatBits.size() - 1); j++)
+                assert(floatBits[j] == bits[j]);
+        }
+    }
+}
+
+/* Pulses which land exactly on a window edge are where the two PLLs can
+ * disagree: the fixed-point one always puts the pulse in the later window,
+ * while the floating point one may put it in the earlier one. Anywhere else
+ * they must agree. The PLL is held still so that the edges are exact. */
+
+static void test_windowedges()
+{
+    auto decodeEdge = [](const Fluxmap& fluxmap, unsigned clock, bool fixed)
+    {
+        DecoderParams params;
+        params.fixedPointPll = fixed;
+        params.pllAdjust = 0.0;
+        params.pllPhase = 1.0;
+        params.pulseDebounceThreshold = 0.0;
+
+        FluxmapReader fmr(fluxmap, params);
+        FluxDecoder decoder(&fmr, clock * NS_PER_TICK, params);
+        return decoder.readBits();
+    };
+
+    auto expected = [](unsigned zeroes)
+    {
+        RawBits bits;
+        bits.push_back(true);
+        bits.push_back(true);
+        for (unsigned i = 0; i < zeroes; i++)
+            bits.push_back(false);
+        for (int i = 0; i < 3; i++)
+            bits.push_back(true);
+        return bits;
+    };
+
+    for (unsigned clock = 2; clock <= 64; clock += 2)
+    {
+        for (unsigned windows = 1; windows <= 4; windows++)
+        {
+            unsigned edge = windows * clock + clock / 2;
+            for (int delta : {-1, 0, 1})
+            {
+                Fluxmap fluxmap;
+                fluxmap.appendInterval(clock).appendPulse();
+                fluxmap.appendInterval(edge + delta).appendPulse();
+                fluxmap.appendInterval(clock).appendPulse();
+                fluxmap.appendInterval(clock).appendPulse();
+
+                auto floatBits = decodeEdge(fluxmap, clock, false);
+                auto fixedBits = decodeEdge(fluxmap, clock, true);
+                if (delta == 0)
+                {
+                    assert(fixedBits == expected(windows));
+                    assert((floatBits == expected(windows)) ||
+                           (floatBits == expected(windows - 1)));
+                }
+                else
+                {
+                    assert(fixedBits == expected(windows - (delta < 0)));
+                    assert(fixedBits == floatBits);
+                }
+            }
+        }
+    }
+}
+
+static void test_reset()
+{
+    auto bits = randomMfm(2000);
+    auto fluxmap = makeFlux(bits, 24.0);
+    nanoseconds_t bitcell = 24.0 * NS_PER_TICK;
+
+    DecoderParams params;
+    params.fixedPointPll = true;
+
+    FluxmapReader fmr(fluxmap);
+    FluxDecoder decoder(&fmr, bitcell * 1.1, params);
+    decoder.readBits(500);
+
+    fmr.rewind();
+    decoder.reset(&fmr, bitcell);
+    assert(decoder.readBits() == decode(fluxmap, bitcell, true));
+}
+
+int main(int argc, const char* argv[])
+{
+    test_bitexactness();
+    test_windowedges();
+    test_reset();
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "lib/globals.h"
+#include "lib/bytes.h"
+#include "lib/fluxmap.h"
+#include <chrono>
+
+/* Not a test: measures how quickly bytecode can be appended to a fluxmap,
+ * compared with the old byte-at-a-time loop. Run it by hand. The bytecode is
+ * split into track-sized fluxmaps, each built from USB-transfer-sized
+ * chunks.
+ *
+ * On glibc, page faults from fresh allocations can dominate the appendBytes
+ * figure; running with MALLOC_MMAP_THRESHOLD_=268435456 and
+ * MALLOC_TRIM_THRESHOLD_=268435456 shows the cost of the copy itself. */
+
+static const size_t SIZE = 32 * 1024 * 1024;
+static const size_t TRACK = 1024 * 1024;
+static const size_t CHUNK = 64 * 1024;
+static const int REPEATS = 10;
+
+static Bytes makeBytecode()
+{
+    Bytes bytes(SIZE);
+    uint8_t* p = bytes.begin();
+    uint32_t seed = 1;
+    for (size_t i = 0; i < SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        p[i] = F_BIT_PULSE | ((seed >> 16) % 0x3f);
+    }
+    return bytes;
+}
+
+static unsigned appendByteAtATime(Bytes& bytes, const uint8_t* ptr, size_t len)
+{
+    unsigned ticks = 0;
+    ByteWriter bw(bytes);
+    bw.seekToEnd();
+    while (len--)
+    {
+        uint8_t byte = *ptr++;
+        ticks += byte & 0x3f;
+        bw.write_8(byte);
+    }
+    return ticks;
+}
+
+/* Reports the best of several runs. */
+
+template <typename F>
+static void measure(const char* name, F f)
+{
+    double best = 0;
+    unsigned ticks;
+    for (int i = 0; i < REPEATS; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ticks = f();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = std::max(best, SIZE / elapsed.count() / 1e9);
+    }
+
+    std::cout << fmt::format(
+        "{:<28} {:8.3f} GB/s  (ticks {})\n", name, best, ticks);
+}
+
+int main(int argc, const char* argv[])
+{
+    Bytes bytecode = makeBytecode();
+    const uint8_t* ptr = bytecode.cbegin();
+
+    measure("byte at a time",
+        [&]
+        {
+            unsigned ticks = 0;
+            for (size_t t = 0; t < SIZE; t += TRACK)
+            {
+                Bytes bytes;
+                for (size_t i = t; i < (t + TRACK); i += CHUNK)
+                    ticks += appendByteAtATime(bytes, ptr + i, CHUNK);
+            }
+            return ticks;
+        });
+
+    measure("appendBytes",
+        [&]
+        {
+            unsigned ticks = 0;
+            for (size_t t = 0; t < SIZE; t += TRACK)
+            {
+                Fluxmap fluxmap;
+                for (size_t i = t; i < (t + TRACK); i += CHUNK)
+                    fluxmap.appendBytes(ptr + i, CHUNK);
+                ticks += fluxmap.ticks();
+            }
+            return ticks;
+        });
+
+    measure("wrapping existing Bytes",
+        [&]
+        {
+            unsigned ticks = 0;
+            for (size_t t = 0; t < SIZE; t += TRACK)
+                ticks += Fluxmap(bytecode.slice(t, TRACK)).ticks();
+            return ticks;
+        });
+
+    return 0;
+}
@@ -79,11 +79,262 @@ void test_read_desyncs()
     ASSERT_READ_SPECIFIC_EVENT(F_DESYNC, 0x60);
 }
 
+void test_seek()
+{
+    FluxmapReader fmr(fluxmap);
+    ASSERT_READ_SPECIFIC_EVENT(F_BIT_PULSE, 0x30);
+    ASSERT_READ_SPECIFIC_EVENT(F_BIT_PULSE, 0x60);
+    Fluxmap::Position pos = fmr.tell();
+    ASSERT_READ_SPECIFIC_EVENT(F_BIT_PULSE, 0x60);
+
+    fmr.seek(pos);
+    ASSERT_READ_SPECIFIC_EVENT(F_BIT_PULSE, 0x60);
+    ASSERT_READ_SPECIFIC_EVENT(F_BIT_PULSE, 0x30);
+
+    /* Seeking into the middle of a run of non-event bytes only counts the
+     * remainder of the interval. */
+
+    pos.bytes = 5;
+    pos.ticks = 0x30 * 4;
+    fmr.seek(pos);
+    ASSERT_NEXT_EVENT(F_BIT_PULSE, 0x30);
+    assertThat(fmr.tell().ticks).isEqualTo(0x30 * 5);
+
+    fmr.seekToByte(2);
+    ASSERT_NEXT_EVENT(F_BIT_INDEX, 0x30);
+    ASSERT_NEXT_EVENT(F_BIT_PULSE | F_BIT_INDEX, 0x30);
+}
+
+/* Seeking with the checkpoint table must land in exactly the same place as
+ * walking the fluxmap from the beginning. */
+
+void test_seek_checkpoints()
+{
+    Fluxmap fm;
+    for (int i = 0; i < 10000; i++)
+    {
+        fm.appendInterval(1 + (rand() % 200));
+        switch (rand() % 8)
+        {
+            case 0:
+                fm.appendIndex();
+                break;
+
+            case 1:
+                fm.appendDesync();
+                break;
+
+            default:
+                fm.appendPulse();
+                break;
+        }
+    }
+
+    std::vector<Fluxmap::Position> positions;
+    {
+        FluxmapReader fmr(fm);
+        positions.push_back(fmr.tell());
+        while (!fmr.eof())
+        {
+            int event;
+            unsigned ticks;
+            fmr.getNextEvent(event, ticks);
+            positions.push_back(fmr.tell());
+        }
+    }
+
+    FluxmapReader fmr(fm);
+    for (int i = 0; i < 1000; i++)
+    {
+        nanoseconds_t ns = (rand() % (fm.ticks() + 100)) * NS_PER_TICK;
+        unsigned ticks = ns / NS_PER_TICK;
+        auto expected = std::find_if(positions.begin(),
+            positions.end(),
+            [&](const auto& pos)
+            {
+                return pos.ticks >= ticks;
+            });
+        if (expected == positions.end())
+            expected--;
+
+        fmr.seek(ns);
+        assertThat(fmr.tell().bytes).isEqualTo(expected->bytes);
+        assertThat(fmr.tell().ticks).isEqualTo(expected->ticks);
+
+        unsigned bytes = rand() % (fm.bytes() + 10);
+        expected = std::find_if(positions.begin(),
+            positions.end(),
+            [&](const auto& pos)
+            {
+                return pos.bytes >= bytes;
+            });
+        if (expected == positions.end())
+            expected--;
+
+        fmr.seekToByte(bytes);
+        assertThat(fmr.tell().bytes).isEqualTo(expected->bytes);
+        assertThat(fmr.tell().ticks).isEqualTo(expected->ticks);
+    }
+}
+
+void test_modified_fluxmap()
+{
+    Fluxmap fm;
+    fm.appendInterval(0x10).appendPulse();
+    {
+        FluxmapReader fmr(fm);
+        ASSERT_NEXT_EVENT(F_BIT_PULSE, 0x10);
+        ASSERT_NEXT_EVENT(F_EOF, 0);
+    }
+
+    fm.appendInterval(0x20).appendIndex();
+    {
+        FluxmapReader fmr(fm);
+        ASSERT_NEXT_EVENT(F_BIT_PULSE, 0x10);
+        ASSERT_NEXT_EVENT(F_BIT_INDEX, 0x20);
+        ASSERT_NEXT_EVENT(F_EOF, 0);
+    }
+}
+
+void test_split_views()
+{
+    auto maps = fluxmap.split();
+    assertThat(maps.size()).isEqualTo(3);
+    assertThat(maps[0]->ticks()).isEqualTo(0x30 * 5);
+    assertThat(maps[1]->ticks()).isEqualTo(0x60);
+    assertThat(maps[2]->ticks()).isEqualTo(0x60);
+
+    /* The pieces share the original bytecode... */
+
+    assert(maps[0]->ptr() == fluxmap.ptr() + 1);
+    assert(maps[1]->ptr() == fluxmap.ptr() + 7);
+
+    /* ...but modifying one doesn't affect the original. */
+
+    Fluxmap fm(*maps[1]);
+    fm.appendPulse();
+    assertThat((int)fluxmap.rawBytes()[8]).isEqualTo(0x30);
+    assertThat((int)fm.rawBytes()[1]).isEqualTo(F_BIT_PULSE | 0x30);
+}
+
+void test_tick_count()
+{
+    /* Covers both the vector and scalar parts of the tick summation, and
+     * appending to a fluxmap which already has data. */
+
+    for (unsigned len = 0; len < 100; len++)
+    {
+        Bytes bytes(len);
+        unsigned wanted = 0;
+        for (unsigned i = 0; i < len; i++)
+        {
+            uint8_t b = (i * 37 + len) & 0xff;
+            bytes[i] = b;
+            wanted += b & 0x3f;
+        }
+
+        Fluxmap fm;
+        fm.appendBytes(bytes);
+        assertThat(fm.ticks()).isEqualTo(wanted);
+
+        fm.appendBytes(bytes.cbegin(), len);
+        assertThat(fm.ticks()).isEqualTo(wanted * 2);
+        assertThat(fm.bytes()).isEqualTo(len * 2);
+        assert(fm.rawBytes().slice(len) == bytes);
+    }
+}
+
+void test_compact()
+{
+    Fluxmap fm;
+    fm.appendInterval(10).appendPulse();
+    fm.appendInterval(0x3f * 2 + 5).appendPulse();
+    fm.appendInterval(0x3f * 3).appendIndex();
+    fm.appendInterval(0x3f * 100000).appendPulse();
+    fm.appendDesync();
+    fm.appendByte(0xff);
+    fm.appendInterval(0x3f * 4);
+
+    /* The long gap shrinks to a few bytes. */
+
+    Bytes compact = fm.compactBytes();
+    assert(compact.size() < 30);
+
+    Fluxmap copy;
+    copy.appendCompactBytes(compact);
+    assert(copy.rawBytes() == fm.rawBytes());
+    assertThat(copy.ticks()).isEqualTo(fm.ticks());
+
+    bool failed = false;
+    try
+    {
+        Fluxmap().appendCompactBytes(Bytes{0x80, 0xff});
+    }
+    catch (const ErrorException& e)
+    {
+        failed = true;
+    }
+    assert(failed);
+}
+
+void test_compacted()
+{
+    Fluxmap fm;
+    for (int i = 0; i < 10; i++)
+        fm.appendInterval(0x3f * 1000 + i).appendPulse();
+    fm.appendInterval(0x3f * 5000).appendIndex();
+
+    auto compact = fm.compacted();
+    assert(compact);
+    assert(compact->isCompact());
+    assertThat(compact->bytes()).isEqualTo(fm.bytes());
+    assertThat(compact->ticks()).isEqualTo(fm.ticks());
+    assert(compact->rawBytes() == fm.rawBytes());
+
+    /* It reads exactly the same. */
+
+    FluxmapReader fmr1(fm);
+    FluxmapReader fmr2(*compact);
+    for (;;)
+    {
+        int e1, e2;
+        unsigned t1, t2;
+        fmr1.getNextEvent(e1, t1);
+        fmr2.getNextEvent(e2, t2);
+        assertThat(e2).isEqualTo(e1);
+        assertThat(t2).isEqualTo(t1);
+        assertThat(fmr2.tell().bytes).isEqualTo(fmr1.tell().bytes);
+        if (e1 == F_EOF)
+            break;
+    }
+
+    /* Modifying it turns it back into bytecode. */
+
+    Fluxmap copy = *compact;
+    copy.appendInterval(10).appendPulse();
+    assert(!copy.isCompact());
+    assertThat(copy.bytes()).isEqualTo(fm.bytes() + 1);
+
+    /* Ordinary flux isn't worth compacting. */
+
+    Fluxmap dense;
+    for (int i = 0; i < 1000; i++)
+        dense.appendInterval(20 + (i % 30)).appendPulse();
+    assert(!dense.compacted());
+}
+
 int main(int argc, const char* argv[])
 {
     test_read_all_events();
     test_read_pulses();
     test_read_indices();
     test_read_desyncs();
+    test_seek();
+    test_seek_checkpoints();
+    test_modified_fluxmap();
+    test_split_views();
+    test_tick_count();
+    test_compact();
+    test_compacted();
     return 0;
 }
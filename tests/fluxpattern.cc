@@ -2,6 +2,7 @@
 #include "lib/fluxmap.h"
 #include "lib/decoders/fluxmapreader.h"
 #include <sstream>
+#include <math.h>
 
 typedef std::vector<unsigned> ivector;
 
@@ -87,17 +88,24 @@ void test_patternmatchingwithouttrailingzeros()
     const unsigned closematch1[] = {90, 90, 180, 90};
     const unsigned closematch2[] = {110, 110, 220, 110};
 
+    DecoderParams params;
     FluxMatch match;
-    assert(fp.matches(&matching[4], match), true);
+    assert(fp.matches(&matching[4], params, match), true);
     assert(match.intervals, 2U);
 
-    assert(fp.matches(&notmatching[4], match), false);
+    assert(fp.matches(&notmatching[4], params, match), false);
 
-    assert(fp.matches(&closematch1[4], match), true);
+    assert(fp.matches(&closematch1[4], params, match), true);
     assert(match.intervals, 2U);
 
-    assert(fp.matches(&closematch2[4], match), true);
+    assert(fp.matches(&closematch2[4], params, match), true);
     assert(match.intervals, 2U);
+
+    const unsigned skewed[] = {100, 100, 210, 95};
+    assert(fp.matches(&skewed[4], params, match), true);
+    params.bitErrorThreshold = 0.05;
+    assert(fp.matches(&skewed[4], params, match), false);
+    assert(fp.matches(&closematch1[4], params, match), true);
 }
 
 void test_patternmatchingwithtrailingzeros()
@@ -108,23 +116,119 @@ void test_patternmatchingwithtrailingzeros()
     const unsigned closematch1[] = {90, 90, 180, 90, 300};
     const unsigned closematch2[] = {110, 110, 220, 110, 220};
 
+    DecoderParams params;
     FluxMatch match;
-    assert(fp.matches(&matching[5], match), true);
+    assert(fp.matches(&matching[5], params, match), true);
     assert(match.intervals, 3U);
 
-    assert(fp.matches(&notmatching[5], match), false);
+    assert(fp.matches(&notmatching[5], params, match), false);
 
-    assert(fp.matches(&closematch1[5], match), true);
+    assert(fp.matches(&closematch1[5], params, match), true);
     assert(match.intervals, 3U);
 
-    assert(fp.matches(&closematch2[5], match), true);
+    assert(fp.matches(&closematch2[5], params, match), true);
     assert(match.intervals, 3U);
 }
 
+/* The original floating-point matcher, which the integer one must agree with
+ * exactly. */
+static bool referenceMatches(const ivector& pattern,
+    unsigned length,
+    bool lowzero,
+    const unsigned* end,
+    double threshold)
+{
+    const unsigned* start = end - pattern.size();
+    unsigned candidatelength = std::accumulate(start, end - lowzero, 0);
+    if (!candidatelength)
+        return false;
+    double clock = (double)candidatelength / (double)length;
+
+    unsigned exactIntervals = pattern.size() - lowzero;
+    for (unsigned i = 0; i < exactIntervals; i++)
+    {
+        double ii = clock * (double)pattern[i];
+        double ci = (double)start[i];
+        if (fabs((ii - ci) / clock) > threshold)
+            return false;
+    }
+
+    if (lowzero)
+    {
+        double ii = clock * (double)pattern[exactIntervals];
+        double ci = (double)start[exactIntervals];
+        if (((ii - ci) / clock) > threshold)
+            return false;
+    }
+    return true;
+}
+
+void test_patternmatchingequivalence()
+{
+    const FluxPattern patterns[] = {
+        FluxPattern(16, 0x000b),
+        FluxPattern(16, 0x0016),
+        FluxPattern(48, 0x448944894489LL),
+        FluxPattern(16, 0xf57e),
+    };
+
+    srand(0);
+    for (const auto& fp : patterns)
+    {
+        unsigned length = 0;
+        for (unsigned i = 0; i < fp._intervals.size() - fp._lowzero; i++)
+            length += fp._intervals[i];
+
+        for (int i = 0; i < 100000; i++)
+        {
+            /* Use small intervals so that errors of exactly the threshold
+             * turn up often. */
+
+            unsigned scale = 1 + rand() % 8;
+            std::vector<unsigned> candidates;
+            for (unsigned interval : fp._intervals)
+                candidates.push_back(
+                    std::max(0, (int)(interval * scale) + (rand() % 7) - 3));
+
+            const unsigned* end = candidates.data() + candidates.size();
+            for (double threshold : {0.0, 0.2, 0.25, 0.4, 0.5})
+            {
+                unsigned candidatelength = std::accumulate(
+                    candidates.begin(), candidates.end() - fp._lowzero, 0);
+                FluxMatch match;
+                assert(fp.matches(end, candidatelength, threshold, match),
+                    referenceMatches(
+                        fp._intervals, length, fp._lowzero, end, threshold));
+            }
+        }
+    }
+}
+
+void test_matcherflattening()
+{
+    FluxPattern fp1(16, 0x000b);
+    FluxPattern fp2(16, 0x0016);
+    FluxPattern fp3(16, 0x0050);
+    FluxMatchers inner({&fp2, &fp3});
+    FluxMatchers outer({&fp1, &inner});
+
+    assert(outer.patterns().size(), (size_t)3);
+    assert(outer.patterns()[0] == &fp1, true);
+    assert(outer.patterns()[1] == &fp2, true);
+    assert(outer.patterns()[2] == &fp3, true);
+    assert(outer.intervals(), 3U);
+
+    FluxPattern copy = fp1;
+    assert(copy.patterns().size(), (size_t)1);
+    assert(copy.patterns()[0] == &copy, true);
+}
+
 int main(int argc, const char* argv[])
 {
     test_patternconstruction();
     test_patternmatchingwithouttrailingzeros();
     test_patternmatchingwithtrailingzeros();
+    test_patternmatchingequivalence();
+    test_matcherflattening();
     return 0;
 }
@@ -46,6 +46,173 @@ static void testDecode(void)
            }) == Bytes{0x80});
 }
 
+/* The original bit-at-a-time implementations, which the word-level kernels
+ * must match exactly. */
+
+static Bytes referenceDecodeFmMfm(
+    std::vector<bool>::const_iterator ii, std::vector<bool>::const_iterator end)
+{
+    Bytes bytes;
+    ByteWriter bw(bytes);
+
+    int bitcount = 0;
+    uint8_t fifo = 0;
+
+    while (ii != end)
+    {
+        ii++; /* skip clock bit */
+        if (ii == end)
+            break;
+        fifo = (fifo << 1) | *ii++;
+
+        bitcount++;
+        if (bitcount == 8)
+        {
+            bw.write_8(fifo);
+            bitcount = 0;
+        }
+    }
+
+    if (bitcount != 0)
+    {
+        fifo <<= 8 - bitcount;
+        bw.write_8(fifo);
+    }
+
+    return bytes;
+}
+
+static void referenceEncodeFm(
+    std::vector<bool>& bits, unsigned& cursor, const Bytes& input)
+{
+    if (bits.size() == 0)
+        return;
+    unsigned len = bits.size() - 1;
+
+    for (uint8_t b : input)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            bool bit = b & 0x80;
+            b <<= 1;
+
+            if (cursor >= len)
+                return;
+
+            bits[cursor++] = true;
+            bits[cursor++] = bit;
+        }
+    }
+}
+
+static void referenceEncodeMfm(std::vector<bool>& bits,
+    unsigned& cursor,
+    const Bytes& input,
+    bool& lastBit)
+{
+    if (bits.size() == 0)
+        return;
+    unsigned len = bits.size() - 1;
+
+    for (uint8_t b : input)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            bool bit = b & 0x80;
+            b <<= 1;
+
+            if (cursor >= len)
+                return;
+
+            bits[cursor++] = !lastBit && !bit;
+            bits[cursor++] = bit;
+            lastBit = bit;
+        }
+    }
+}
+
+static std::vector<bool> randomBits(unsigned count)
+{
+    std::vector<bool> bits;
+    for (unsigned i = 0; i < count; i++)
+        bits.push_back(rand() & 1);
+    return bits;
+}
+
+static Bytes randomBytes(unsigned count)
+{
+    Bytes bytes;
+    ByteWriter bw(bytes);
+    for (unsigned i = 0; i < count; i++)
+        bw.write_8(rand());
+    return bytes;
+}
+
+static void testKernelEquivalence(FmMfmKernel kernel)
+{
+    if (!setFmMfmKernel(kernel))
+        return;
+
+    for (int i = 0; i < 10000; i++)
+    {
+        auto bits = randomBits(rand() % 300);
+        unsigned skip = bits.empty() ? 0 : (rand() % bits.size());
+        RawBits rawBits(bits);
+        assert(decodeFmMfm(rawBits) ==
+               referenceDecodeFmMfm(bits.begin(), bits.end()));
+        assert(decodeFmMfm(rawBits.begin() + skip, rawBits.end()) ==
+               referenceDecodeFmMfm(bits.begin() + skip, bits.end()));
+
+        Bytes input = randomBytes(rand() % 20);
+        unsigned size = rand() % 400;
+        unsigned startCursor = size ? (rand() % size) : 0;
+        bool startLastBit = rand() & 1;
+
+        {
+            std::vector<bool> expected(size);
+            unsigned expectedCursor = startCursor;
+            bool expectedLastBit = startLastBit;
+            referenceEncodeMfm(
+                expected, expectedCursor, input, expectedLastBit);
+
+            std::vector<bool> actual(size);
+            unsigned actualCursor = startCursor;
+            bool actualLastBit = startLastBit;
+            encodeMfm(actual, actualCursor, input, actualLastBit);
+
+            assert(actual == expected);
+            assert(actualCursor == expectedCursor);
+            assert(actualLastBit == expectedLastBit);
+        }
+
+        {
+            std::vector<bool> expected(size);
+            unsigned expectedCursor = startCursor;
+            referenceEncodeFm(expected, expectedCursor, input);
+
+            std::vector<bool> actual(size);
+            unsigned actualCursor = startCursor;
+            encodeFm(actual, actualCursor, input);
+
+            assert(actual == expected);
+            assert(actualCursor == expectedCursor);
+        }
+
+        {
+            std::vector<bool> expected(input.size() * 16);
+            unsigned cursor = 0;
+            bool expectedLastBit = startLastBit;
+            referenceEncodeMfm(expected, cursor, input, expectedLastBit);
+
+            bool actualLastBit = startLastBit;
+            assert(encodeMfm(input, actualLastBit) == toBytes(expected));
+            assert(actualLastBit == expectedLastBit);
+        }
+    }
+
+    setFmMfmKernel(FMMFM_KERNEL_BEST);
+}
+
 static std::vector<bool> wrappedEncodeMfm(const Bytes& bytes)
 {
     std::vector<bool> bits(16);
@@ -161,5 +328,7 @@ int main(int argc, const char* argv[])
     testDecode();
     testEncodeMfm();
     testEncodeFm();
+    testKernelEquivalence(FMMFM_KERNEL_TABLE);
+    testKernelEquivalence(FMMFM_KERNEL_BMI2);
     return 0;
 }
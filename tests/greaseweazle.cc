@@ -64,8 +64,37 @@ static void test_conversions()
         Bytes{0x3f} * 0x41 + Bytes{0x81});
 }
 
+static void test_rescaling()
+{
+    /* A 72MHz Greaseweazle samples exactly six times per FluxEngine tick. */
+
+    const uint32_t sampleFrequency = TICK_FREQUENCY * 6;
+    Bytes gwbytes = {6, 12, 60, 0};
+    Bytes flbytes = {0x81, 0x82, 0x8a};
+
+    Bytes gwdata;
+    ByteWriter bw(gwdata);
+    fluxEngineToGreaseweazle(flbytes,
+        sampleFrequency,
+        [&](const uint8_t* buffer, size_t len)
+        {
+            bw += Bytes(buffer, len);
+        });
+    assert(gwdata == gwbytes);
+
+    ByteReader br(gwbytes);
+    Bytes fldata = greaseWeazleToFluxEngine(
+        [&]()
+        {
+            return br.read_8();
+        },
+        sampleFrequency);
+    assert(fldata == flbytes);
+}
+
 int main(int argc, const char* argv[])
 {
     test_conversions();
+    test_rescaling();
     return 0;
 }
@@ -158,10 +158,59 @@ static void test_skew()
         Equals(std::vector<unsigned>{0, 6, 1, 7, 2, 8, 3, 9, 4, 10, 5, 11}));
 }
 
+static void test_cache()
+{
+    globalConfig().clear();
+    globalConfig().readBaseConfig(R"M(
+		drive {
+			drive_type: DRIVETYPE_80TRACK
+		}
+
+		layout {
+			format_type: FORMATTYPE_80TRACK
+			tracks: 78
+			sides: 2
+			layoutdata {
+				sector_size: 256
+				physical {
+					start_sector: 0
+					count: 4
+				}
+			}
+		}
+	)M");
+
+    auto layout = Layout::getLayoutOfTrack(1, 1);
+    AssertThat(Layout::getLayoutOfTrack(1, 1).get(), Equals(layout.get()));
+    AssertThat(Layout::getLayoutOfTrack(1, 0).get(), !Equals(layout.get()));
+    AssertThat(layout->numSectors, Equals(4U));
+
+    auto outside = Layout::getLayoutOfTrack(90, 0);
+    AssertThat(Layout::getLayoutOfTrack(90, 0).get(), Equals(outside.get()));
+
+    globalConfig().set("layout.tracks", "40");
+    AssertThat(Layout::getLayoutOfTrack(1, 1).get(), !Equals(layout.get()));
+
+    globalConfig().readBaseConfig(R"M(
+		layout {
+			layoutdata {
+				physical {
+					count: 5
+				}
+			}
+		}
+	)M");
+    auto changed = Layout::getLayoutOfTrack(1, 1);
+    AssertThat(changed.get(), !Equals(layout.get()));
+    AssertThat(changed->numSectors, Equals(5U));
+    AssertThat(layout->numSectors, Equals(4U));
+}
+
 int main(int argc, const char* argv[])
 {
     test_physical_sectors();
     test_logical_sectors();
     test_both_sectors();
     test_skew();
+    test_cache();
 }
@@ -0,0 +1,112 @@
+#include "lib/globals.h"
+#include "lib/bytes.h"
+#include "lib/decoders/rawbits.h"
+#include <assert.h>
+
+static std::vector<bool> randomBits(unsigned count)
+{
+    std::vector<bool> bits;
+    for (unsigned i = 0; i < count; i++)
+        bits.push_back(rand() & 1);
+    return bits;
+}
+
+static uint64_t referenceRead(
+    const std::vector<bool>& bits, size_t pos, unsigned count)
+{
+    uint64_t value = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        size_t j = pos + i;
+        value = (value << 1) | ((j < bits.size()) ? bits[j] : false);
+    }
+    return value;
+}
+
+static void test_pushback()
+{
+    for (unsigned count : {0, 1, 7, 63, 64, 65, 200})
+    {
+        auto reference = randomBits(count);
+        RawBits bits(reference);
+
+        assert(bits.size() == count);
+        assert(bits.empty() == (count == 0));
+        assert(bits.toVector() == reference);
+        assert(std::equal(bits.begin(), bits.end(), reference.begin()));
+        assert((size_t)(bits.end() - bits.begin()) == count);
+        for (unsigned i = 0; i < count; i++)
+            assert(bits[i] == reference[i]);
+    }
+}
+
+static void test_read()
+{
+    auto reference = randomBits(300);
+    RawBits bits(reference);
+
+    for (size_t pos = 0; pos < 310; pos++)
+        for (unsigned count = 0; count <= 64; count++)
+            assert(
+                bits.read(pos, count) == referenceRead(reference, pos, count));
+}
+
+static void test_append()
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        auto left = randomBits(rand() % 150);
+        auto right = randomBits(rand() % 150);
+
+        RawBits bits(left);
+        bits.append(RawBits(right));
+
+        std::vector<bool> reference = left;
+        reference.insert(reference.end(), right.begin(), right.end());
+        assert(bits == RawBits(reference));
+
+        RawBits words(left);
+        unsigned count = rand() % 65;
+        uint64_t value = ((uint64_t)rand() << 32) ^ rand();
+        words.append(value, count);
+        for (unsigned j = 0; j < count; j++)
+            left.push_back((value >> (count - 1 - j)) & 1);
+        assert(words == RawBits(left));
+    }
+}
+
+static void test_slice()
+{
+    auto reference = randomBits(200);
+    RawBits bits(reference);
+
+    for (size_t pos = 0; pos < 210; pos += 7)
+        for (size_t count = 0; count < 210; count += 11)
+        {
+            size_t end = std::min(pos + count, reference.size());
+            std::vector<bool> expected;
+            if (pos < end)
+                expected.assign(
+                    reference.begin() + pos, reference.begin() + end);
+            assert(bits.slice(pos, count) == RawBits(expected));
+        }
+}
+
+static void test_tobytes()
+{
+    for (unsigned count : {0, 1, 8, 13, 64, 100})
+    {
+        auto reference = randomBits(count);
+        assert(toBytes(RawBits(reference)) == toBytes(reference));
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    test_pushback();
+    test_read();
+    test_append();
+    test_slice();
+    test_tobytes();
+    return 0;
+}